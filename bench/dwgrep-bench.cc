@@ -0,0 +1,239 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+// A micro-benchmark driver for libzwerg.  Runs a fixed catalogue of
+// queries over each Dwarf file given on the command line and reports,
+// for each query, the number of results, throughput in DIEs and
+// results per second, and the number of heap allocations per result.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "libzwerg.hh"
+#include "libzwerg-dw.h"
+
+namespace
+{
+  std::atomic <size_t> g_allocs {0};
+}
+
+void *
+operator new (size_t size)
+{
+  ++g_allocs;
+  if (void *ret = std::malloc (size != 0 ? size : 1))
+    return ret;
+  throw std::bad_alloc {};
+}
+
+void
+operator delete (void *ptr) noexcept
+{
+  std::free (ptr);
+}
+
+void
+operator delete (void *ptr, size_t) noexcept
+{
+  std::free (ptr);
+}
+
+namespace
+{
+  struct bench_query
+  {
+    char const *name;
+    char const *query;
+  };
+
+  bench_query const g_catalogue[] = {
+    {"entry",		"entry"},
+    {"raw-entry",	"raw entry"},
+    {"child*",		"unit root child*"},
+    {"parent",		"entry parent"},
+    {"@AT_type",	"entry @AT_type"},
+    {"@AT_type*",	"entry ?AT_type @AT_type*"},
+    {"?match",		"entry name ?(\"^.*_t$\" ?match)"},
+    {"symbol",		"symbol"},
+    {"abbrev",		"entry abbrev"},
+    {"location",	"entry @AT_location elem"},
+  };
+
+  struct measurement
+  {
+    size_t runs;
+    size_t results;
+    size_t allocs;
+    double seconds;
+  };
+
+  // Run QUERY over DW over and over until at least MIN_TIME seconds
+  // pass.  RESULTS is the number of results of one run.
+  measurement
+  measure (zw_vocabulary const &voc, zw_value const &dw,
+	   char const *query, double min_time)
+  {
+    typedef std::chrono::steady_clock clock;
+
+    std::unique_ptr <zw_query, zw_deleter> q
+	{zw_query_parse (&voc, query, zw_throw_on_error {})};
+    std::unique_ptr <zw_stack, zw_deleter> stk
+	{zw_stack_init (zw_throw_on_error {})};
+    zw_stack_push (stk.get (), &dw, zw_throw_on_error {});
+
+    measurement ret {0, 0, 0, 0};
+    size_t allocs = g_allocs;
+    auto start = clock::now ();
+    do
+      {
+	size_t results = 0;
+	for (std::unique_ptr <zw_result, zw_deleter> result
+		 {zw_query_execute (q.get (), stk.get (),
+				    zw_throw_on_error {})};
+	     auto out = zw_result_next (*result); )
+	  ++results;
+
+	ret.results = results;
+	++ret.runs;
+	ret.seconds = std::chrono::duration <double>
+	  (clock::now () - start).count ();
+      }
+    while (ret.seconds < min_time);
+
+    ret.allocs = g_allocs - allocs;
+    return ret;
+  }
+
+  size_t
+  count_dies (zw_vocabulary const &voc, zw_value const &dw)
+  {
+    return measure (voc, dw, "raw entry", 0).results;
+  }
+
+  void
+  usage (char const *argv0)
+  {
+    std::cerr << "Usage: " << argv0
+	      << " [--min-time=SECONDS] [--query=NAME]... FILE...\n"
+	      << "Queries:";
+    for (auto const &bq: g_catalogue)
+      std::cerr << ' ' << bq.name;
+    std::cerr << std::endl;
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  double min_time = 0.5;
+  std::vector <std::string> only;
+  std::vector <char const *> files;
+
+  for (int i = 1; i < argc; ++i)
+    if (std::strncmp (argv[i], "--min-time=", 11) == 0)
+      min_time = std::atof (argv[i] + 11);
+    else if (std::strncmp (argv[i], "--query=", 8) == 0)
+      only.push_back (argv[i] + 8);
+    else if (std::strcmp (argv[i], "--help") == 0)
+      {
+	usage (argv[0]);
+	return 0;
+      }
+    else
+      files.push_back (argv[i]);
+
+  if (files.empty ())
+    {
+      usage (argv[0]);
+      return 2;
+    }
+
+  try
+    {
+      std::unique_ptr <zw_vocabulary, zw_deleter> voc
+	{zw_vocabulary_init (zw_throw_on_error {})};
+      zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+			 zw_throw_on_error {});
+      zw_vocabulary_add (voc.get (), zw_vocabulary_dwarf (zw_throw_on_error {}),
+			 zw_throw_on_error {});
+
+      for (auto fn: files)
+	{
+	  std::unique_ptr <zw_value, zw_deleter> dw
+	    {zw_value_init_dwarf (fn, 0, zw_throw_on_error {})};
+	  size_t dies = count_dies (*voc, *dw);
+
+	  std::cout << fn << ": " << dies << " DIEs\n"
+		    << std::setw (12) << std::left << "query"
+		    << std::right
+		    << std::setw (10) << "results"
+		    << std::setw (8) << "runs"
+		    << std::setw (14) << "DIEs/s"
+		    << std::setw (14) << "results/s"
+		    << std::setw (14) << "allocs/result" << std::endl;
+
+	  for (auto const &bq: g_catalogue)
+	    {
+	      if (! only.empty ()
+		  && std::find (only.begin (), only.end (), bq.name)
+			== only.end ())
+		continue;
+
+	      measurement m = measure (*voc, *dw, bq.query, min_time);
+	      size_t total = m.results * m.runs;
+	      std::cout << std::setw (12) << std::left << bq.name
+			<< std::right << std::fixed << std::setprecision (0)
+			<< std::setw (10) << m.results
+			<< std::setw (8) << m.runs
+			<< std::setw (14) << dies * m.runs / m.seconds
+			<< std::setw (14) << total / m.seconds
+			<< std::setw (14) << std::setprecision (2)
+			<< (total != 0 ? (double) m.allocs / total : 0.)
+			<< std::endl;
+	    }
+	  std::cout << std::endl;
+	}
+    }
+  catch (std::runtime_error const &e)
+    {
+      std::cerr << "Error: " << e.what () << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Generate a C source file that, compiled with -g, yields Dwarf with
+# roughly N structure types, typedefs and functions.  Each structure
+# points at the previous one, so type chains grow with N.
+#
+# Usage: gen-dwarf.sh N > synth.c
+
+N=${1:-1000}
+
+awk -v n="$N" 'BEGIN {
+  print "struct s_0 { int a; };"
+  print "typedef struct s_0 s_0_t;"
+  for (i = 1; i <= n; ++i) {
+    printf "struct s_%d { int a; long b; char name[16];\n", i
+    printf "  struct s_%d *prev; s_%d_t const *cprev; };\n", i - 1, i - 1
+    printf "typedef struct s_%d s_%d_t;\n", i, i
+    printf "int f_%d (s_%d_t *p, int x) {\n", i, i
+    printf "  int y = x * %d;\n", i
+    printf "  for (int j = 0; j < x; ++j) y += p->name[j %% 16];\n"
+    printf "  return p->prev != 0 ? y + p->prev->a : y;\n"
+    printf "}\n"
+  }
+}'
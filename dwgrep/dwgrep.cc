@@ -28,9 +28,13 @@
    not, see <http://www.gnu.org/licenses/>.  */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <exception>
 #include <fstream>
 #include <functional>
 #include <getopt.h>
@@ -39,7 +43,11 @@
 #include <libintl.h>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 #include "libzwerg.hh"
@@ -104,6 +112,16 @@ show_help (std::vector <ext_option> const &ext_opts)
     }
 }
 
+// How results are written out.  Besides the human-readable text,
+// results can be written as JSON Lines, one result per line, or as
+// length-prefixed binary records.  See --format for details.
+enum class output_format
+  {
+    text,
+    jsonl,
+    binary,
+  };
+
 class dumper
 {
   zw_vocabulary const &m_voc;
@@ -123,6 +141,15 @@ public:
 
   void dump_value (std::ostream &os, zw_value const &val, format fmt);
 
+  // Write one result, the stack STK, in format OFMT.  HEADER, if not
+  // NULL, identifies the input that the result comes from.
+  void dump_result (std::ostream &os, zw_stack const &stk,
+		    std::string const *header, output_format ofmt);
+
+  // Write result count COUNT in format OFMT.
+  void dump_count (std::ostream &os, uint64_t count,
+		   std::string const *header, output_format ofmt);
+
 private:
   void dump_const (std::ostream &os, zw_value const &val, format fmt);
   void dump_charp (std::ostream &os, char const *buf, size_t len, format fmt);
@@ -132,11 +159,34 @@ private:
   void dump_cu (std::ostream &os, zw_value const &val, format fmt);
   void dump_die (std::ostream &os, zw_value const &val, format fmt);
   void dump_attr (std::ostream &os, zw_value const &val, format fmt);
+  void dump_attr_values (std::ostream &os, unsigned name,
+			 zw_value const &values, format fmt);
   void dump_llelem (std::ostream &os, zw_value const &val, format fmt);
   void dump_llop (std::ostream &os, zw_value const &val, format fmt);
   void dump_aset (std::ostream &os, zw_value const &val, format fmt);
   void dump_elfsym (std::ostream &os, zw_value const &val, format fmt);
   void dump_named_constant (std::ostream &os, unsigned cst, zw_cdom const &dom);
+
+  // Brief names of DW_TAG_ and DW_AT_ constants, which are looked up
+  // for every DIE and attribute dumped.
+  std::map <std::pair <zw_cdom const *, unsigned>, std::string> m_names;
+  std::string const &const_name (unsigned v, zw_cdom const &dom);
+
+  void dump_json (std::ostream &os, zw_value const &val, bool top);
+  void dump_json_attr (std::ostream &os, unsigned name,
+		       zw_value const &values);
+
+  void dump_binary (zw_value const &val, bool top);
+  void dump_binary_attr (unsigned name, zw_value const &values);
+
+  // Text of values that have no structured representation.
+  std::string const &text_of (zw_value const &val);
+
+  // Record that's being encoded in binary format.  Kept around so that
+  // its storage is reused across results.
+  std::string m_record;
+  std::ostringstream m_text;
+  std::string m_text_str;
 };
 
 void
@@ -254,77 +304,339 @@ exec_query_on (zw_value const &val, zw_query const &q,
   return exec_query_on (*stack, q, cb);
 }
 
-void
-dumper::dump_die (std::ostream &os, zw_value const &val, format fmt)
+std::string const &
+dumper::const_name (unsigned v, zw_cdom const &dom)
 {
-  Dwarf_Die die = zw_value_die_die (&val);
-  std::unique_ptr <zw_value, zw_deleter> tag
-	{zw_value_init_const_u64 (dwarf_tag (&die), zw_cdom_dw_tag (), 0,
-				  zw_throw_on_error {})};
+  auto key = std::make_pair (&dom, v);
+  auto it = m_names.find (key);
+  if (it != m_names.end ())
+    return it->second;
+
+  std::unique_ptr <zw_value, zw_deleter> cst
+	{zw_value_init_const_u64 (v, &dom, 0, zw_throw_on_error {})};
+  std::unique_ptr <zw_value, zw_deleter> tmp
+	{zw_value_const_format_brief (cst.get (), zw_throw_on_error {})};
+
+  size_t sz;
+  auto buf = zw_value_str_str (tmp.get (), &sz);
+  return m_names.emplace (key, std::string {buf, sz}).first->second;
+}
+
+namespace
+{
+  // Call F on each attribute as it is physically present at DIE, the
+  // same as "raw attribute" would yield.  An exception thrown by F is
+  // not let through libdw, but rethrown once dwarf_getattrs returns.
+  template <class F>
+  void
+  for_each_attribute (Dwarf_Die &die, F f)
+  {
+    struct context
+    {
+      F &f;
+      std::exception_ptr failure;
+    } ctx {f, nullptr};
+
+    auto cb = [] (Dwarf_Attribute *at, void *data) -> int
+      {
+	auto &ctx = *static_cast <context *> (data);
+	try
+	  {
+	    ctx.f (*at);
+	    return DWARF_CB_OK;
+	  }
+	catch (...)
+	  {
+	    ctx.failure = std::current_exception ();
+	    return DWARF_CB_ABORT;
+	  }
+      };
+
+    if (dwarf_getattrs (&die, cb, &ctx, 0) == -1)
+      throw std::runtime_error (dwarf_errmsg (-1));
+    if (ctx.failure != nullptr)
+      std::rethrow_exception (ctx.failure);
+  }
+
+  // A stream buffer that writes what is put to it to OS as the body
+  // of a JSON string.  Valid UTF-8 is written as it is, other bytes
+  // are escaped as \u00XX, so that the output is valid JSON whatever
+  // the input.
+  class json_outbuf
+    : public std::streambuf
+  {
+    std::streambuf &m_out;
+
+    // A multi-byte sequence that's being put.  M_LEN bytes of it are
+    // in M_SEQ, and it is M_WANT bytes long.
+    unsigned char m_seq[4];
+    unsigned m_len;
+    unsigned m_want;
+
+    void
+    put_escaped (unsigned char c)
+    {
+      static char const digits[] = "0123456789abcdef";
+      char const esc[] = {'\\', 'u', '0', '0', digits[c >> 4], digits[c & 0xf]};
+      m_out.sputn (esc, sizeof esc);
+    }
+
+    void
+    put_pending ()
+    {
+      for (unsigned i = 0; i < m_len; ++i)
+	put_escaped (m_seq[i]);
+      m_len = 0;
+    }
+
+    // Whether C continues the pending sequence.  The second byte is
+    // restricted further for some lead bytes, to rule out overlong
+    // forms, surrogates and code points past U+10FFFF.
+    bool
+    continues (unsigned char c) const
+    {
+      unsigned char lo = 0x80, hi = 0xbf;
+      if (m_len == 1)
+	switch (m_seq[0])
+	  {
+	  case 0xe0: lo = 0xa0; break;
+	  case 0xed: hi = 0x9f; break;
+	  case 0xf0: lo = 0x90; break;
+	  case 0xf4: hi = 0x8f; break;
+	  }
+      return c >= lo && c <= hi;
+    }
+
+  public:
+    explicit json_outbuf (std::ostream &os)
+      : m_out (*os.rdbuf ())
+      , m_len {0}
+      , m_want {0}
+    {}
+
+    void
+    put (unsigned char c)
+    {
+      if (m_len > 0)
+	{
+	  if (continues (c))
+	    {
+	      m_seq[m_len++] = c;
+	      if (m_len == m_want)
+		{
+		  m_out.sputn (reinterpret_cast <char const *> (m_seq), m_len);
+		  m_len = 0;
+		}
+	      return;
+	    }
+	  put_pending ();
+	}
+
+      if (c >= 0x80)
+	{
+	  m_want = c >= 0xc2 && c <= 0xdf ? 2
+	    : c >= 0xe0 && c <= 0xef ? 3
+	    : c >= 0xf0 && c <= 0xf4 ? 4 : 0;
+	  if (m_want == 0)
+	    put_escaped (c);
+	  else
+	    m_seq[m_len++] = c;
+	}
+      else if (c == '"' || c == '\\')
+	{
+	  m_out.sputc ('\\');
+	  m_out.sputc (c);
+	}
+      else if (c == '\n')
+	m_out.sputn ("\\n", 2);
+      else if (c == '\t')
+	m_out.sputn ("\\t", 2);
+      else if (c < 0x20)
+	put_escaped (c);
+      else
+	m_out.sputc (c);
+    }
+
+    // Escape what's left of a sequence cut short by the end of the
+    // string.
+    void
+    finish ()
+    {
+      put_pending ();
+    }
+
+  protected:
+    int_type
+    overflow (int_type c) override
+    {
+      if (! traits_type::eq_int_type (c, traits_type::eof ()))
+	put (traits_type::to_char_type (c));
+      return traits_type::not_eof (c);
+    }
 
-  std::string tag_name = [&] ()
+    std::streamsize
+    xsputn (char const *s, std::streamsize n) override
     {
-      std::unique_ptr <zw_value, zw_deleter> tmp
-	{zw_value_const_format_brief (tag.get (), zw_throw_on_error {})};
+      for (std::streamsize i = 0; i < n; ++i)
+	put (s[i]);
+      return n;
+    }
+  };
+
+  void
+  json_string (std::ostream &os, char const *buf, size_t len)
+  {
+    os << '"';
+    json_outbuf jb {os};
+    for (size_t i = 0; i < len; ++i)
+      jb.put (buf[i]);
+    jb.finish ();
+    os << '"';
+  }
+
+  void
+  json_string (std::ostream &os, std::string const &str)
+  {
+    json_string (os, str.c_str (), str.length ());
+  }
+
+  void
+  json_string (std::ostream &os, char const *str)
+  {
+    json_string (os, str, strlen (str));
+  }
+
+  void
+  put_u8 (std::string &buf, uint8_t v)
+  {
+    buf += (char) v;
+  }
+
+  void
+  put_u32 (std::string &buf, uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i, v >>= 8)
+      buf += (char) (v & 0xff);
+  }
+
+  void
+  set_u32 (std::string &buf, size_t pos, uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i, v >>= 8)
+      buf[pos + i] = (char) (v & 0xff);
+  }
+
+  void
+  put_u64 (std::string &buf, uint64_t v)
+  {
+    for (int i = 0; i < 8; ++i, v >>= 8)
+      buf += (char) (v & 0xff);
+  }
+
+  void
+  put_str (std::string &buf, char const *str, size_t len)
+  {
+    put_u32 (buf, len);
+    buf.append (str, len);
+  }
+
+  void
+  put_str (std::string &buf, std::string const &str)
+  {
+    put_str (buf, str.c_str (), str.length ());
+  }
 
-      size_t sz;
-      auto buf = zw_value_str_str (tmp.get (), &sz);
-      return std::string {buf, sz};
-    } ();
+  void
+  put_str (std::string &buf, char const *str)
+  {
+    put_str (buf, str, strlen (str));
+  }
+
+  // Binary records are prefixed with their length, which is only
+  // known once the whole record is encoded.
+  void
+  write_record (std::ostream &os, std::string const &rec)
+  {
+    char len[4];
+    for (size_t i = 0, v = rec.length (); i < 4; ++i, v >>= 8)
+      len[i] = v & 0xff;
+    os.write (len, sizeof len);
+    os.write (rec.c_str (), rec.length ());
+  }
+
+  Dwarf_Off
+  die_cu_offset (Dwarf_Die &die)
+  {
+    Dwarf_Die cudie;
+    if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
+      throw std::runtime_error (dwarf_errmsg (-1));
+    return dwarf_dieoffset (&cudie);
+  }
+
+  char const *
+  die_file_name (zw_value const &val)
+  {
+    return zw_value_dwarf_name (zw_value_die_dwarf (&val,
+						    zw_throw_on_error {}));
+  }
+}
+
+void
+dumper::dump_die (std::ostream &os, zw_value const &val, format fmt)
+{
+  Dwarf_Die die = zw_value_die_die (&val);
 
   {
     ios_flag_saver ifs {os};
     os << '[' << std::hex << dwarf_dieoffset (&die) << ']'
-       << (fmt == format::full ? '\t' : ' ') << tag_name;
+       << (fmt == format::full ? '\t' : ' ')
+       << const_name (dwarf_tag (&die), *zw_cdom_dw_tag ());
   }
 
   if (fmt == format::full)
     {
-      static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "raw attribute", zw_throw_on_error {})};
-      exec_query_on (val, *query,
-		     [&] (zw_stack const &stk) -> void {
-		       assert (zw_stack_depth (&stk) == 1);
-		       dump_attr (os << "\n\t", *zw_stack_at (&stk, 0),
-				  format::brief);
-		     });
+      for_each_attribute (die, [&] (Dwarf_Attribute &at)
+	{
+	  std::unique_ptr <zw_value, zw_deleter> values
+		{zw_value_die_attr_values (&val, &at, zw_throw_on_error {})};
+	  dump_attr_values (os << "\n\t", dwarf_whatattr (&at), *values,
+			    format::brief);
+	});
     }
 }
 
 void
 dumper::dump_attr (std::ostream &os, zw_value const &val, format fmt)
 {
-  static std::unique_ptr <zw_query, zw_deleter> query
-	{zw_query_parse (&m_voc, "[value] swap label", zw_throw_on_error {})};
-  exec_query_on (val, *query,
-		 [&] (zw_stack const &stk) -> void
-		 {
-		   assert (zw_stack_depth (&stk) == 2);
-		   dump_value (os, *zw_stack_at (&stk, 0), format::brief);
+  Dwarf_Attribute at = zw_value_attr_attr (&val);
+  std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
+  dump_attr_values (os, dwarf_whatattr (&at), *values, fmt);
+}
 
-		   zw_value const *values = zw_stack_at (&stk, 1);
-		   assert (zw_value_is_seq (values));
+void
+dumper::dump_attr_values (std::ostream &os, unsigned name,
+			  zw_value const &values, format fmt)
+{
+  assert (zw_value_is_seq (&values));
+  os << const_name (name, *zw_cdom_dw_attr ());
 
-		   switch (size_t n = zw_value_seq_length (values))
-		     {
-		     case 0:
-		       os << "\t<no value>";
-		       break;
-		     case 1:
-		       dump_value (os << "\t",
-				   *zw_value_seq_at (values, 0),
-				   format::brief);
-		       break;
-		     default:
-		       for (size_t i = 0; i < n; ++i)
-			 {
-			   os << (fmt == format::brief ? "\n\t\t" : "\n\t");
-			   dump_value (os, *zw_value_seq_at (values, i),
-				       format::brief);
-			 }
-		       break;
-		     }
-		 });
+  switch (size_t n = zw_value_seq_length (&values))
+    {
+    case 0:
+      os << "\t<no value>";
+      break;
+    case 1:
+      dump_value (os << "\t", *zw_value_seq_at (&values, 0), format::brief);
+      break;
+    default:
+      for (size_t i = 0; i < n; ++i)
+	{
+	  os << (fmt == format::brief ? "\n\t\t" : "\n\t");
+	  dump_value (os, *zw_value_seq_at (&values, i), format::brief);
+	}
+      break;
+    }
 }
 
 void
@@ -495,101 +807,931 @@ dumper::dump_value (std::ostream &os, zw_value const &val, format fmt)
     os << ">";
 }
 
-namespace
+std::string const &
+dumper::text_of (zw_value const &val)
 {
-  std::ostream &
-  error_message (bool no_messages)
-  {
-    static std::ofstream sink;
-    std::ostream &ret = no_messages ? sink : std::cerr;
-    return ret;
-  }
-
-  std::ostream &
-  error_message (bool no_messages, int verbosity, bool &errors)
-  {
-    if (verbosity >= 0)
-      errors = true;
-    return error_message (no_messages);
-  }
-
-  std::vector <std::unique_ptr <zw_value, zw_deleter>>
-  parse_arg_literal (std::string arg)
-  {
-    std::unique_ptr <zw_value, zw_deleter> value
-	{zw_value_init_str_len (arg.c_str (), arg.length (), 0,
-				zw_throw_on_error {})};
-    std::vector <std::unique_ptr <zw_value, zw_deleter>> ret;
-    ret.emplace_back (std::move (value));
-    return ret;
-  }
-
-  std::vector <std::unique_ptr <zw_value, zw_deleter>>
-  parse_arg_eval (zw_vocabulary const &voc, std::string arg)
-  {
-    std::vector <std::unique_ptr <zw_value, zw_deleter>> ret;
-
-    try
-      {
-	std::unique_ptr <zw_query, zw_deleter> query
-	    {zw_query_parse_len (&voc, arg.c_str (), arg.length (),
-				 zw_throw_on_error {})};
-	std::unique_ptr <zw_stack, zw_deleter> empty
-	    {zw_stack_init (zw_throw_on_error {})};
+  m_text.str ("");
+  dump_value (m_text, val, format::brief);
+  m_text_str = m_text.str ();
+  return m_text_str;
+}
 
-	exec_query_on (*empty, *query,
-		       [&] (zw_stack const &stk) -> void
-		       {
-			 if (zw_stack_depth (&stk) == 0)
-			   throw std::runtime_error ("empty stack yielded");
+void
+dumper::dump_json_attr (std::ostream &os, unsigned name,
+			zw_value const &values)
+{
+  os << "\"name\":";
+  json_string (os, const_name (name, *zw_cdom_dw_attr ()));
+  os << ",\"values\":[";
+  for (size_t n = zw_value_seq_length (&values), i = 0; i < n; ++i)
+    {
+      if (i > 0)
+	os << ',';
+      dump_json (os, *zw_value_seq_at (&values, i), false);
+    }
+  os << ']';
+}
 
-			 zw_value const &tos = *zw_stack_at (&stk, 0);
-			 size_t pos = zw_value_pos (&tos);
-			 std::unique_ptr <zw_value, zw_deleter> value
-			    {zw_value_clone (&tos, pos, zw_throw_on_error {})};
-			 ret.push_back (std::move (value));
-		       });
-      }
-    catch (std::runtime_error const &e)
+void
+dumper::dump_json (std::ostream &os, zw_value const &val, bool top)
+{
+  if (zw_value_is_const (&val))
+    {
+      os << "{\"type\":\"T_CONST\",\"value\":";
+      if (zw_value_const_is_signed (&val))
+	os << zw_value_const_i64 (&val);
+      else
+	os << zw_value_const_u64 (&val);
+
+      // The text of a constant nearly always fits the buffer.  Longer
+      // ones are formatted again once their length is known.
+      char buf[128];
+      size_t len = zw_value_const_format_buf (&val, buf, sizeof buf);
+      os << ",\"text\":";
+      if (len <= sizeof buf)
+	json_string (os, buf, len);
+      else
+	{
+	  std::string str (len, '\0');
+	  zw_value_const_format_buf (&val, &str[0], len);
+	  json_string (os, str);
+	}
+      os << '}';
+    }
+  else if (zw_value_is_str (&val))
+    {
+      size_t len;
+      char const *buf = zw_value_str_str (&val, &len);
+      json_string (os, buf, len);
+    }
+  else if (zw_value_is_seq (&val))
+    {
+      os << '[';
+      for (size_t n = zw_value_seq_length (&val), i = 0; i < n; ++i)
+	{
+	  if (i > 0)
+	    os << ',';
+	  dump_json (os, *zw_value_seq_at (&val, i), false);
+	}
+      os << ']';
+    }
+  else if (zw_value_is_dwarf (&val))
+    {
+      os << "{\"type\":\"T_DWARF\",\"name\":";
+      json_string (os, zw_value_dwarf_name (&val));
+      os << '}';
+    }
+  else if (zw_value_is_cu (&val))
+    os << "{\"type\":\"T_CU\",\"offset\":" << zw_value_cu_offset (&val) << '}';
+  else if (zw_value_is_die (&val))
+    {
+      Dwarf_Die die = zw_value_die_die (&val);
+      os << "{\"type\":\"T_DIE\",\"offset\":" << dwarf_dieoffset (&die)
+	 << ",\"tag\":";
+      json_string (os, const_name (dwarf_tag (&die), *zw_cdom_dw_tag ()));
+      os << ",\"cu\":" << die_cu_offset (die) << ",\"file\":";
+      json_string (os, die_file_name (val));
+
+      // Like in the text format, attributes are only shown for DIE's
+      // that are themselves results, not for those nested in them.
+      if (top)
+	{
+	  os << ",\"attributes\":[";
+	  bool seen = false;
+	  for_each_attribute (die, [&] (Dwarf_Attribute &at)
+	    {
+	      std::unique_ptr <zw_value, zw_deleter> values
+		{zw_value_die_attr_values (&val, &at, zw_throw_on_error {})};
+	      os << (seen ? ",{" : "{");
+	      seen = true;
+	      dump_json_attr (os, dwarf_whatattr (&at), *values);
+	      os << '}';
+	    });
+	  os << ']';
+	}
+      os << '}';
+    }
+  else if (zw_value_is_attr (&val))
+    {
+      Dwarf_Attribute at = zw_value_attr_attr (&val);
+      std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
+      os << "{\"type\":\"T_ATTR\",";
+      dump_json_attr (os, dwarf_whatattr (&at), *values);
+      os << '}';
+    }
+  else
+    {
+      char const *type
+	= zw_value_is_llelem (&val) ? "T_LOCLIST_ELEM"
+	: zw_value_is_llop (&val) ? "T_LOCLIST_OP"
+	: zw_value_is_aset (&val) ? "T_ASET"
+	: zw_value_is_elfsym (&val) ? "T_ELFSYM"
+	: "unknown";
+      os << "{\"type\":\"" << type << "\",\"text\":\"";
       {
-	std::stringstream ss;
-	ss << "When parsing argument `" << arg << "': "
-	   << e.what ();
-	throw std::runtime_error (ss.str ());
+	json_outbuf jb {os};
+	std::ostream jos {&jb};
+	dump_value (jos, val, format::brief);
+	jb.finish ();
       }
+      os << "\"}";
+    }
+}
 
-    return ret;
-  }
-
-  std::unique_ptr <zw_value, zw_deleter>
-  try_open_dwarf (const char *fn, size_t pos, bool no_messages)
-  {
-    try
-      {
-	std::unique_ptr <zw_value, zw_deleter> ret
-	  {zw_value_init_dwarf (fn, pos, zw_throw_on_error {})};
-	return ret;
-      }
-    catch (std::runtime_error const& e)
-      {
-	error_message (no_messages)
-	  << "dwgrep: " << fn << ": " << e.what () << std::endl;
-      }
-    catch (...)
-      {
-	error_message (no_messages)
-	  << "dwgrep: " << fn << ": Unknown error" << std::endl;
-      }
-    return nullptr;
-  }
+void
+dumper::dump_binary_attr (unsigned name, zw_value const &values)
+{
+  put_str (m_record, const_name (name, *zw_cdom_dw_attr ()));
+  size_t n = zw_value_seq_length (&values);
+  put_u32 (m_record, n);
+  for (size_t i = 0; i < n; ++i)
+    dump_binary (*zw_value_seq_at (&values, i), false);
 }
 
-int
-main(int argc, char *argv[])
-try
-  {
-    setlocale (LC_ALL, "");
-    textdomain ("dwgrep");
+void
+dumper::dump_binary (zw_value const &val, bool top)
+{
+  if (zw_value_is_const (&val))
+    {
+      put_u8 (m_record, 'i');
+      if (zw_value_const_is_signed (&val))
+	{
+	  put_u8 (m_record, 1);
+	  put_u64 (m_record, zw_value_const_i64 (&val));
+	}
+      else
+	{
+	  put_u8 (m_record, 0);
+	  put_u64 (m_record, zw_value_const_u64 (&val));
+	}
+
+      std::unique_ptr <zw_value, zw_deleter> str
+	{zw_value_const_format (&val, zw_throw_on_error {})};
+      size_t len;
+      char const *buf = zw_value_str_str (str.get (), &len);
+      put_str (m_record, buf, len);
+    }
+  else if (zw_value_is_str (&val))
+    {
+      size_t len;
+      char const *buf = zw_value_str_str (&val, &len);
+      put_u8 (m_record, 's');
+      put_str (m_record, buf, len);
+    }
+  else if (zw_value_is_seq (&val))
+    {
+      size_t n = zw_value_seq_length (&val);
+      put_u8 (m_record, 'q');
+      put_u32 (m_record, n);
+      for (size_t i = 0; i < n; ++i)
+	dump_binary (*zw_value_seq_at (&val, i), false);
+    }
+  else if (zw_value_is_dwarf (&val))
+    {
+      put_u8 (m_record, 'f');
+      put_str (m_record, zw_value_dwarf_name (&val));
+    }
+  else if (zw_value_is_cu (&val))
+    {
+      put_u8 (m_record, 'u');
+      put_u64 (m_record, zw_value_cu_offset (&val));
+    }
+  else if (zw_value_is_die (&val))
+    {
+      Dwarf_Die die = zw_value_die_die (&val);
+      put_u8 (m_record, 'd');
+      put_u64 (m_record, dwarf_dieoffset (&die));
+      put_u64 (m_record, die_cu_offset (die));
+      put_str (m_record, const_name (dwarf_tag (&die), *zw_cdom_dw_tag ()));
+      put_str (m_record, die_file_name (val));
+
+      if (! top)
+	put_u32 (m_record, 0);
+      else
+	{
+	  // The attribute count is filled in once they have been written.
+	  size_t pos = m_record.size ();
+	  put_u32 (m_record, 0);
+	  uint32_t n = 0;
+	  for_each_attribute (die, [&] (Dwarf_Attribute &at)
+	    {
+	      std::unique_ptr <zw_value, zw_deleter> values
+		{zw_value_die_attr_values (&val, &at, zw_throw_on_error {})};
+	      dump_binary_attr (dwarf_whatattr (&at), *values);
+	      ++n;
+	    });
+	  set_u32 (m_record, pos, n);
+	}
+    }
+  else if (zw_value_is_attr (&val))
+    {
+      Dwarf_Attribute at = zw_value_attr_attr (&val);
+      std::unique_ptr <zw_value, zw_deleter> values
+	{zw_value_attr_values (&val, zw_throw_on_error {})};
+      put_u8 (m_record, 'a');
+      dump_binary_attr (dwarf_whatattr (&at), *values);
+    }
+  else
+    {
+      put_u8 (m_record, 'x');
+      put_str (m_record, text_of (val));
+    }
+}
+
+void
+dumper::dump_result (std::ostream &os, zw_stack const &stk,
+		     std::string const *header, output_format ofmt)
+{
+  size_t n = zw_stack_depth (&stk);
+  switch (ofmt)
+    {
+    case output_format::text:
+      if (header != nullptr)
+	os << *header << ":\n";
+      if (n > 1)
+	os << "---\n";
+      for (size_t i = 0; i < n; ++i)
+	{
+	  auto const *val = zw_stack_at (&stk, i);
+	  assert (val != nullptr);
+	  dump_value (os, *val, format::full);
+	  os << '\n';
+	}
+      return;
+
+    case output_format::jsonl:
+      os << '{';
+      if (header != nullptr)
+	{
+	  os << "\"input\":";
+	  json_string (os, *header);
+	  os << ',';
+	}
+      os << "\"values\":[";
+      for (size_t i = 0; i < n; ++i)
+	{
+	  auto const *val = zw_stack_at (&stk, i);
+	  assert (val != nullptr);
+	  if (i > 0)
+	    os << ',';
+	  dump_json (os, *val, true);
+	}
+      os << "]}\n";
+      return;
+
+    case output_format::binary:
+      m_record.clear ();
+      put_u8 (m_record, 'r');
+      put_str (m_record, header != nullptr ? *header : "");
+      put_u32 (m_record, n);
+      for (size_t i = 0; i < n; ++i)
+	{
+	  auto const *val = zw_stack_at (&stk, i);
+	  assert (val != nullptr);
+	  dump_binary (*val, true);
+	}
+      write_record (os, m_record);
+      return;
+    }
+
+  assert (! "unhandled output format");
+}
+
+void
+dumper::dump_count (std::ostream &os, uint64_t count,
+		    std::string const *header, output_format ofmt)
+{
+  switch (ofmt)
+    {
+    case output_format::text:
+      if (header != nullptr)
+	os << *header << ":";
+      os << std::dec << count << '\n';
+      return;
+
+    case output_format::jsonl:
+      os << '{';
+      if (header != nullptr)
+	{
+	  os << "\"input\":";
+	  json_string (os, *header);
+	  os << ',';
+	}
+      os << "\"count\":" << std::dec << count << "}\n";
+      return;
+
+    case output_format::binary:
+      m_record.clear ();
+      put_u8 (m_record, 'c');
+      put_str (m_record, header != nullptr ? *header : "");
+      put_u64 (m_record, count);
+      write_record (os, m_record);
+      return;
+    }
+
+  assert (! "unhandled output format");
+}
+
+namespace
+{
+  // A stream buffer that writes straight to a file descriptor through
+  // a buffer much larger than what the standard streams use.  Dumping
+  // many small results then costs few write calls.
+  class fd_outbuf
+    : public std::streambuf
+  {
+    int m_fd;
+    std::vector <char> m_buf;
+
+    bool
+    write_out ()
+    {
+      char const *buf = pbase ();
+      size_t len = pptr () - pbase ();
+      while (len > 0)
+	{
+	  ssize_t w = write (m_fd, buf, len);
+	  if (w < 0 && errno == EINTR)
+	    continue;
+	  if (w <= 0)
+	    return false;
+	  buf += w;
+	  len -= w;
+	}
+      setp (m_buf.data (), m_buf.data () + m_buf.size ());
+      return true;
+    }
+
+  protected:
+    int_type
+    overflow (int_type c) override
+    {
+      if (! write_out ())
+	return traits_type::eof ();
+      if (! traits_type::eq_int_type (c, traits_type::eof ()))
+	{
+	  *pptr () = traits_type::to_char_type (c);
+	  pbump (1);
+	}
+      return traits_type::not_eof (c);
+    }
+
+    int
+    sync () override
+    {
+      return write_out () ? 0 : -1;
+    }
+
+  public:
+    fd_outbuf (int fd, size_t size)
+      : m_fd {fd}
+      , m_buf (size)
+    {
+      setp (m_buf.data (), m_buf.data () + m_buf.size ());
+    }
+
+    ~fd_outbuf ()
+    {
+      sync ();
+    }
+  };
+
+  // Redirect std::cout to an fd_outbuf on standard output for the
+  // lifetime of this object.
+  class stdout_buffer
+  {
+    fd_outbuf m_buf;
+    std::streambuf *m_old;
+
+  public:
+    explicit stdout_buffer (size_t size)
+      : m_buf {STDOUT_FILENO, size}
+      , m_old {std::cout.rdbuf (&m_buf)}
+    {}
+
+    ~stdout_buffer ()
+    {
+      std::cout.flush ();
+      std::cout.rdbuf (m_old);
+    }
+  };
+
+  std::ostream &
+  error_message (bool no_messages)
+  {
+    static std::ofstream sink;
+    std::ostream &ret = no_messages ? sink : std::cerr;
+    return ret;
+  }
+
+  std::vector <std::unique_ptr <zw_value, zw_deleter>>
+  parse_arg_literal (std::string arg)
+  {
+    std::unique_ptr <zw_value, zw_deleter> value
+	{zw_value_init_str_len (arg.c_str (), arg.length (), 0,
+				zw_throw_on_error {})};
+    std::vector <std::unique_ptr <zw_value, zw_deleter>> ret;
+    ret.emplace_back (std::move (value));
+    return ret;
+  }
+
+  std::vector <std::unique_ptr <zw_value, zw_deleter>>
+  parse_arg_eval (zw_vocabulary const &voc, std::string arg)
+  {
+    std::vector <std::unique_ptr <zw_value, zw_deleter>> ret;
+
+    try
+      {
+	std::unique_ptr <zw_query, zw_deleter> query
+	    {zw_query_parse_len (&voc, arg.c_str (), arg.length (),
+				 zw_throw_on_error {})};
+	std::unique_ptr <zw_stack, zw_deleter> empty
+	    {zw_stack_init (zw_throw_on_error {})};
+
+	exec_query_on (*empty, *query,
+		       [&] (zw_stack const &stk) -> void
+		       {
+			 if (zw_stack_depth (&stk) == 0)
+			   throw std::runtime_error ("empty stack yielded");
+
+			 zw_value const &tos = *zw_stack_at (&stk, 0);
+			 size_t pos = zw_value_pos (&tos);
+			 std::unique_ptr <zw_value, zw_deleter> value
+			    {zw_value_clone (&tos, pos, zw_throw_on_error {})};
+			 ret.push_back (std::move (value));
+		       });
+      }
+    catch (std::runtime_error const &e)
+      {
+	std::stringstream ss;
+	ss << "When parsing argument `" << arg << "': "
+	   << e.what ();
+	throw std::runtime_error (ss.str ());
+      }
+
+    return ret;
+  }
+
+  std::unique_ptr <zw_value, zw_deleter>
+  try_open_dwarf (const char *fn, size_t pos, std::ostream &es)
+  {
+    try
+      {
+	std::unique_ptr <zw_value, zw_deleter> ret
+	  {zw_value_init_dwarf (fn, pos, zw_throw_on_error {})};
+	return ret;
+      }
+    catch (std::runtime_error const& e)
+      {
+	es << "dwgrep: " << fn << ": " << e.what () << std::endl;
+      }
+    catch (...)
+      {
+	es << "dwgrep: " << fn << ": Unknown error" << std::endl;
+      }
+    return nullptr;
+  }
+  typedef std::vector <std::unique_ptr <zw_value, zw_deleter>> arg_val_vec_t;
+
+  // Files named on the command line.  Each is opened only when a unit
+  // gets to it, and closed as soon as the unit is done, so that the
+  // number of open files doesn't grow with the number of arguments.
+  typedef std::vector <char const *> file_vec_t;
+
+  struct run_options
+  {
+    int verbosity;
+    bool show_count;
+    bool with_header;
+    bool have_files;
+    output_format format;
+
+    // Whether to flush the output after each result, so that results
+    // show up as they are found.  That's only useful when a human is
+    // watching.
+    bool flush;
+  };
+
+  struct run_status
+  {
+    bool match = false;
+    bool errors = false;
+  };
+
+  // Whether VAL can be used by queries running on several threads at
+  // once.  Values that refer to a Dwarf share its underlying context,
+  // which is not thread-safe.
+  bool
+  is_thread_safe (zw_value const &val)
+  {
+    if (zw_value_is_const (&val) || zw_value_is_str (&val)
+	|| zw_value_is_aset (&val))
+      return true;
+
+    if (zw_value_is_seq (&val))
+      {
+	for (size_t n = zw_value_seq_length (&val), i = 0; i < n; ++i)
+	  if (! is_thread_safe (*zw_value_seq_at (&val, i)))
+	    return false;
+	return true;
+      }
+
+    return false;
+  }
+
+  std::string
+  make_header (dumper &dump, zw_value const *file,
+	       std::vector <arg_val_vec_t> const &args,
+	       std::vector <size_t> const &idx)
+  {
+    std::stringstream ss;
+    bool seen = false;
+
+    // Always show the file name given on the command line.
+    if (file != nullptr)
+      {
+	dump.dump_value (ss, *file, dumper::format::header);
+	seen = true;
+      }
+
+    for (size_t i = 0; i < args.size (); ++i)
+      {
+	zw_value const &cur = *args[i][idx[i]];
+	if (args[i].size () > 1)
+	  {
+	    if (seen)
+	      ss << ',';
+	    dump.dump_value (ss, cur, dumper::format::header);
+	    seen = true;
+	  }
+      }
+    if (! seen)
+      ss << "<no-file>";
+    return ss.str ();
+  }
+
+  // Run QUERY for each combination of argument values whose first
+  // coordinate is FIRST.  When FILES is not empty, the first
+  // coordinate is a file from FILES, which is opened for the duration
+  // of the unit, otherwise it's a value from ARGS.  Results are dumped
+  // to OS, error messages to ES.  Returns false if no further queries
+  // should be run, which is when a match was found in quiet mode.
+  bool
+  run_unit (zw_vocabulary const &voc, zw_query const &query,
+	    file_vec_t const &files, std::vector <arg_val_vec_t> const &args,
+	    size_t first, run_options const &opts,
+	    std::ostream &os, std::ostream &es, run_status &status)
+  {
+    std::unique_ptr <zw_value, zw_deleter> file;
+    if (! files.empty ())
+      {
+	file = try_open_dwarf (files[first], first, es);
+	if (file == nullptr)
+	  return true;
+      }
+
+    // The coordinate that stays fixed for the whole unit.
+    size_t fixed = file != nullptr ? 0 : 1;
+    std::vector <size_t> idx (args.size (), 0);
+    if (file == nullptr && ! idx.empty ())
+      idx[0] = first;
+
+    dumper dump {voc};
+    while (true)
+      {
+	std::unique_ptr <zw_stack, zw_deleter> stack
+	    {zw_stack_init (zw_throw_on_error {})};
+
+	if (file != nullptr)
+	  {
+	    std::unique_ptr <zw_value, zw_deleter> value
+		{zw_value_clone (file.get (), first, zw_throw_on_error {})};
+	    zw_stack_push_take (stack.get (), value.release (),
+				zw_throw_on_error {});
+	  }
+
+	for (size_t i = 0; i < args.size (); ++i)
+	  {
+	    zw_value const &cur = *args[i][idx[i]];
+	    size_t pos = zw_value_pos (&cur);
+	    std::unique_ptr <zw_value, zw_deleter> value
+		{zw_value_clone (&cur, pos, zw_throw_on_error {})};
+	    zw_stack_push_take (stack.get (), value.release (),
+				zw_throw_on_error {});
+	  }
+
+	std::string header = make_header (dump, file.get (), args, idx);
+
+	try
+	  {
+	    std::unique_ptr <zw_result, zw_deleter> result
+		{zw_query_execute (&query, stack.get (),
+				   zw_throw_on_error {})};
+
+	    uint64_t count = 0;
+	    while (auto out = zw_result_next (*result))
+	      {
+		// grep: Exit immediately with zero status if any match
+		// is found, even if an error was detected.
+		status.match = true;
+		if (opts.verbosity < 0)
+		  return false;
+
+		if (! opts.show_count)
+		  {
+		    dump.dump_result (os, *out,
+				      opts.with_header ? &header : nullptr,
+				      opts.format);
+		    if (opts.flush)
+		      os << std::flush;
+		  }
+		else
+		  ++count;
+	      }
+
+	    if (opts.show_count)
+	      dump.dump_count (os, count, opts.with_header ? &header : nullptr,
+			       opts.format);
+	  }
+	catch (std::runtime_error const &e)
+	  {
+	    if (opts.verbosity >= 0)
+	      status.errors = true;
+	    es << "dwgrep: " << header << ": " << e.what () << std::endl;
+	  }
+	catch (...)
+	  {
+	    if (opts.verbosity >= 0)
+	      status.errors = true;
+	    es << "dwgrep: " << header << ": Unknown error" << std::endl;
+	  }
+
+	// Bump argument list.  The first coordinate stays fixed for the
+	// whole unit.
+	bool next = false;
+	for (size_t ri = 0; ri + fixed < args.size (); ++ri)
+	  {
+	    size_t i = args.size () - 1 - ri;
+	    if (++idx[i] == args[i].size ())
+	      idx[i] = 0;
+	    else
+	      {
+		next = true;
+		break;
+	      }
+	  }
+	if (! next)
+	  return true;
+      }
+  }
+
+  // Run UNITS units (see run_unit) on a pool of JOBS threads.  Each unit
+  // covers one value of the first argument, typically one file given on
+  // the command line, so any one Dwarf context is only ever touched by a
+  // single thread.  Output of each unit is buffered and, unless
+  // UNORDERED, emitted in the same order that a serial run would have.
+  run_status
+  run_parallel (zw_vocabulary const &voc, zw_query const &query,
+		file_vec_t const &files,
+		std::vector <arg_val_vec_t> const &args, size_t units,
+		run_options const &opts, bool no_messages,
+		unsigned jobs, bool unordered)
+  {
+    struct unit_output
+    {
+      std::stringstream out;
+      std::stringstream err;
+      run_status status;
+    };
+
+    std::vector <unit_output> outputs (units);
+    std::atomic <size_t> next_unit {0};
+    std::atomic <bool> stop {false};
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector <size_t> completed;
+    unsigned running = std::min <size_t> (jobs, units);
+    std::exception_ptr failure;
+
+    auto worker = [&] ()
+      {
+	for (size_t u; ! stop && (u = next_unit++) < units; )
+	  {
+	    unit_output &uo = outputs[u];
+	    try
+	      {
+		if (! run_unit (voc, query, files, args, u, opts,
+				uo.out, uo.err, uo.status))
+		  stop = true;
+	      }
+	    catch (std::runtime_error const &e)
+	      {
+		uo.err << "dwgrep: " << e.what () << std::endl;
+		uo.status.errors = true;
+	      }
+	    catch (...)
+	      {
+		// An exception escaping the thread would terminate the
+		// program.  Stop the pool and rethrow it in the main
+		// thread instead.
+		std::lock_guard <std::mutex> lock {mtx};
+		if (failure == nullptr)
+		  failure = std::current_exception ();
+		stop = true;
+	      }
+
+	    std::lock_guard <std::mutex> lock {mtx};
+	    completed.push_back (u);
+	    cv.notify_one ();
+	  }
+
+	std::lock_guard <std::mutex> lock {mtx};
+	--running;
+	cv.notify_one ();
+      };
+
+    std::vector <std::thread> threads;
+    for (unsigned i = running; i > 0; --i)
+      threads.emplace_back (worker);
+
+    run_status ret;
+    auto flush = [&] (unit_output &uo)
+      {
+	// Inserting an empty buffer would set failbit on the stream.
+	if (uo.out.tellp () > 0)
+	  std::cout << uo.out.rdbuf ();
+	if (opts.flush)
+	  std::cout << std::flush;
+	if (uo.err.tellp () > 0)
+	  error_message (no_messages) << uo.err.rdbuf () << std::flush;
+	ret.match = ret.match || uo.status.match;
+	ret.errors = ret.errors || uo.status.errors;
+      };
+
+    // Units are handed out in order, so when the pool stops early, the
+    // units that never ran are all past those that did, and the
+    // in-order flush below never waits for them.
+    std::vector <bool> done (units, false);
+    size_t next_ordered = 0;
+    for (bool last = false; ! last; )
+      {
+	std::vector <size_t> batch;
+	{
+	  std::unique_lock <std::mutex> lock {mtx};
+	  cv.wait (lock, [&] () {
+	      return ! completed.empty () || running == 0;
+	    });
+	  batch.swap (completed);
+	  last = running == 0;
+	}
+
+	for (size_t u: batch)
+	  if (unordered)
+	    flush (outputs[u]);
+	  else
+	    done[u] = true;
+
+	for (; next_ordered < units && done[next_ordered]; ++next_ordered)
+	  flush (outputs[next_ordered]);
+      }
+
+    for (auto &thread: threads)
+      thread.join ();
+
+    if (failure != nullptr)
+      std::rethrow_exception (failure);
+
+    return ret;
+  }
+
+  // Run QUERY over the sole file given on the command line on a pool
+  // of JOBS threads, splitting the units of that file among them.  Each
+  // thread opens the file anew, so that no Dwarf context is shared.
+  // Results are shown as they come, counts are summed up.
+  run_status
+  run_split (zw_vocabulary const &voc, zw_query const &query,
+	     char const *fn, std::vector <arg_val_vec_t> const &args,
+	     run_options const &opts, bool no_messages, unsigned jobs)
+  {
+    run_status ret;
+    std::unique_ptr <zw_value, zw_deleter> file
+	{try_open_dwarf (fn, 0, error_message (no_messages))};
+    if (file == nullptr)
+      return ret;
+
+    std::unique_ptr <zw_cu_pool, void (*) (zw_cu_pool *)> pool
+	{zw_cu_pool_init (file.get (), zw_throw_on_error {}),
+	 zw_cu_pool_destroy};
+
+    dumper dump {voc};
+    std::string header = make_header (dump, file.get (), args,
+				      std::vector <size_t> (args.size (), 0));
+
+    std::mutex mtx;
+    std::set <std::string> errors;
+    std::atomic <bool> stop {false};
+    std::atomic <bool> match {false};
+    std::atomic <uint64_t> count {0};
+    std::exception_ptr failure;
+
+    auto worker = [&] ()
+      {
+	dumper dump {voc};
+	try
+	  {
+	    std::unique_ptr <zw_stack, zw_deleter> stack
+		{zw_stack_init (zw_throw_on_error {})};
+
+	    std::unique_ptr <zw_value, zw_deleter> pooled
+		{zw_value_init_dwarf_pooled (file.get (), pool.get (), 0,
+					     zw_throw_on_error {})};
+	    zw_stack_push_take (stack.get (), pooled.release (),
+				zw_throw_on_error {});
+
+	    for (size_t i = 0; i < args.size (); ++i)
+	      {
+		zw_value const &cur = *args[i][0];
+		size_t pos = zw_value_pos (&cur);
+		std::unique_ptr <zw_value, zw_deleter> value
+		    {zw_value_clone (&cur, pos, zw_throw_on_error {})};
+		zw_stack_push_take (stack.get (), value.release (),
+				    zw_throw_on_error {});
+	      }
+
+	    std::unique_ptr <zw_result, zw_deleter> result
+		{zw_query_execute (&query, stack.get (),
+				   zw_throw_on_error {})};
+
+	    while (! stop)
+	      {
+		auto out = zw_result_next (*result);
+		if (out == nullptr)
+		  break;
+
+		match = true;
+		if (opts.verbosity < 0)
+		  stop = true;
+		else if (opts.show_count)
+		  ++count;
+		else
+		  {
+		    std::stringstream ss;
+		    dump.dump_result (ss, *out,
+				      opts.with_header ? &header : nullptr,
+				      opts.format);
+
+		    std::lock_guard <std::mutex> lock {mtx};
+		    std::cout << ss.rdbuf ();
+		    if (opts.flush)
+		      std::cout << std::flush;
+		  }
+	      }
+	  }
+	catch (std::runtime_error const &e)
+	  {
+	    // All threads run the same query, and likely fail the same
+	    // way.  Only show each message once.
+	    std::lock_guard <std::mutex> lock {mtx};
+	    if (errors.insert (e.what ()).second)
+	      error_message (no_messages)
+		<< "dwgrep: " << header << ": " << e.what () << std::endl;
+	  }
+	catch (...)
+	  {
+	    std::lock_guard <std::mutex> lock {mtx};
+	    if (failure == nullptr)
+	      failure = std::current_exception ();
+	    stop = true;
+	  }
+      };
+
+    std::vector <std::thread> threads;
+    for (unsigned i = 0; i < jobs; ++i)
+      threads.emplace_back (worker);
+    for (auto &thread: threads)
+      thread.join ();
+
+    if (failure != nullptr)
+      std::rethrow_exception (failure);
+
+    if (opts.show_count && opts.verbosity >= 0)
+      dump.dump_count (std::cout, count,
+		       opts.with_header ? &header : nullptr, opts.format);
+
+    ret.match = match;
+    ret.errors = ! errors.empty () && opts.verbosity >= 0;
+    return ret;
+  }
+}
+
+int
+main(int argc, char *argv[])
+try
+  {
+    setlocale (LC_ALL, "");
+    textdomain ("dwgrep");
 
     std::unique_ptr <option[]> long_options = gen_options (ext_options);
     std::string options = gen_shopts (ext_options);
@@ -599,6 +1741,12 @@ try
     bool show_count = false;
     bool with_header = false;
     bool no_header = false;
+    unsigned jobs = 1;
+    unsigned max_open_files = 0;
+    bool unordered_output = false;
+    output_format format = output_format::text;
+    bool explain_only = false;
+    bool explain_run = false;
 
     std::unique_ptr <zw_vocabulary, zw_deleter> voc
 	{zw_vocabulary_init (zw_throw_on_error {})};
@@ -613,9 +1761,7 @@ try
 
     // Outer vector has one element per argument.
     // Inner vector has one element per value yielded by that argument expr.
-    typedef std::vector <std::unique_ptr <zw_value, zw_deleter>> arg_val_vec_t;
     std::vector <arg_val_vec_t> args;
-
     while (true)
       {
 	int c = getopt_long (argc, argv, options.c_str (),
@@ -650,6 +1796,21 @@ try
 	    no_messages = true;
 	    break;
 
+	  case 'j':
+	    {
+	      char *end;
+	      unsigned long n = strtoul (optarg, &end, 10);
+	      if (*optarg == '\0' || *end != '\0' || n > 4096)
+		{
+		  std::cerr << "Error: invalid number of jobs `"
+			    << optarg << "'.\n";
+		  return 2;
+		}
+	      jobs = n != 0 ? n : std::max (std::thread::hardware_concurrency (),
+					    1u);
+	      break;
+	    }
+
 	  case 'f':
 	    {
 	      auto buf_to_string = [] (std::istream &is)
@@ -685,6 +1846,55 @@ try
 		show_help (ext_options);
 		return 0;
 	      }
+	    else if (c == unordered)
+	      {
+		unordered_output = true;
+		break;
+	      }
+	    else if (c == max_open)
+	      {
+		char *end;
+		unsigned long n = strtoul (optarg, &end, 10);
+		if (*optarg == '\0' || *end != '\0' || n == 0 || n > 4096)
+		  {
+		    std::cerr << "Error: invalid number of open files `"
+			      << optarg << "'.\n";
+		    return 2;
+		  }
+		max_open_files = n;
+		break;
+	      }
+	    else if (c == output)
+	      {
+		if (strcmp (optarg, "text") == 0)
+		  format = output_format::text;
+		else if (strcmp (optarg, "jsonl") == 0)
+		  format = output_format::jsonl;
+		else if (strcmp (optarg, "binary") == 0)
+		  format = output_format::binary;
+		else
+		  {
+		    std::cerr << "Error: unknown output format `"
+			      << optarg << "'.\n";
+		    return 2;
+		  }
+		break;
+	      }
+	    else if (c == explain)
+	      {
+		explain_only = true;
+		break;
+	      }
+	    else if (c == explain_analyze)
+	      {
+		explain_run = true;
+		break;
+	      }
+	    else if (c == index_dir)
+	      {
+		zw_dwarf_index_set_dir (optarg);
+		break;
+	      }
 	    else if (c == version)
 	      {
 		std::cout << "dwgrep "
@@ -708,40 +1918,57 @@ try
     std::unique_ptr <zw_query, zw_deleter> query {
 	[&] ()
 	  {
-	    if (query_specified)
-	      return zw_query_parse_len (voc.get (), query_str.c_str (),
-					 query_str.length (),
-					 zw_throw_on_error {});
-	    else
+	    if (! query_specified)
 	      {
 		if (argc == 0)
 		  throw std::runtime_error ("No query specified.");
 
 		argc--;
-		return zw_query_parse (&*voc, *argv++, zw_throw_on_error {});
+		query_str = *argv++;
 	      }
+
+	    if (explain_only || explain_run)
+	      return zw_query_parse_explain (voc.get (), query_str.c_str (),
+					     query_str.length (),
+					     zw_throw_on_error {});
+	    else
+	      return zw_query_parse_len (voc.get (), query_str.c_str (),
+					 query_str.length (),
+					 zw_throw_on_error {});
 	  } ()};
 
-    std::vector <std::string> file_args;
-    if (argc > 0)
+    auto dump_plan = [&query] (std::ostream &os, bool analyze)
       {
-	std::vector <std::unique_ptr <zw_value, zw_deleter>> dwvs;
-	for (int i = 0; i < argc; ++i)
-	  if (std::unique_ptr <zw_value, zw_deleter> dwv
-	      = try_open_dwarf (argv[i], dwvs.size (), no_messages))
-	    {
-	      dwvs.emplace_back (std::move (dwv));
-	      file_args.push_back (argv[i]);
-	    }
+	std::unique_ptr <zw_value, zw_deleter> plan
+	  {zw_query_explain (query.get (), analyze, zw_throw_on_error {})};
+	size_t len;
+	char const *buf = zw_value_str_str (plan.get (), &len);
+	os.write (buf, len);
+      };
+
+    if (explain_only)
+      {
+	dump_plan (std::cout, false);
+	return 0;
+      }
 
-	// Done before we started.
-	if (dwvs.empty ())
-	  return 1;
+    file_vec_t files {argv, argv + argc};
 
-	args.emplace (args.begin (), std::move (dwvs));
-      }
+    // Input stacks hold the argument values, and a Dwarf value if any
+    // files were named.  Reject queries that can't possibly run on
+    // that before opening anything.
+    {
+      size_t need;
+      zw_query_stack_need (query.get (), &need);
+      size_t have = args.size () + (files.empty () ? 0 : 1);
+      if (need > have)
+	throw std::runtime_error
+	  ("Query needs " + std::to_string (need) + " values on stack, but "
+	   + std::to_string (have) + (have == 1 ? " is" : " are")
+	   + " available.");
+    }
 
-    size_t iterations = 1;
+    size_t iterations = files.empty () ? 1 : files.size ();
     for (auto const &arg: args)
       iterations *= arg.size ();
 
@@ -750,127 +1977,68 @@ try
     if (no_header)
       with_header = false;
 
-    std::vector <arg_val_vec_t::const_iterator> arg_its;
-    for (auto const &arg: args)
-      arg_its.push_back (arg.begin ());
-
-    bool errors = false;
-    bool match = false;
-    while (true)
+    bool interactive = isatty (STDOUT_FILENO);
+    run_options opts {verbosity, show_count, with_header, ! files.empty (),
+		      format, interactive};
+    size_t units = iterations == 0 ? 0
+      : opts.have_files ? files.size ()
+      : args.empty () ? 1 : args[0].size ();
+
+    // All units share values of the arguments past the first.  Files
+    // named on the command line each have a Dwarf context of their own,
+    // but other Dwarf-backed values might share one, and those can't be
+    // used from several threads.
+    // Each job keeps at most one file open, and none should be kept
+    // open past the units that use them.
+    if (max_open_files != 0)
       {
-	std::unique_ptr <zw_stack, zw_deleter> stack
-	    {zw_stack_init (zw_throw_on_error {})};
-
-	for (auto const &arg_it: arg_its)
-	  {
-	    zw_value const &cur = *arg_it->get ();
-	    size_t pos = zw_value_pos (&cur);
-	    std::unique_ptr <zw_value, zw_deleter> value
-		{zw_value_clone (&cur, pos, zw_throw_on_error {})};
-	    zw_stack_push_take (stack.get (), value.release (),
-				zw_throw_on_error {});
-	  }
-
-	dumper dump {*voc};
-
-	std::string header = [&] ()
-	  {
-	    std::stringstream ss;
-	    bool seen = false;
-	    for (size_t i = 0; i < args.size (); ++i)
-	      {
-		zw_value const &cur = *arg_its[i]->get ();
-
-		// Always show the first argument if it refers to a file name
-		// given on the command line.
-		if ((i == 0 && file_args.size () > 0) || args[i].size () > 1)
-		  {
-		    if (seen)
-		      ss << ',';
-		    dump.dump_value (ss, cur, dumper::format::header);
-		    seen = true;
-		  }
-	      }
-	    if (! seen)
-	      ss << "<no-file>";
-	    return ss.str ();
-	  } ();
-
-	try
-	  {
-	    std::unique_ptr <zw_result, zw_deleter> result
-		{zw_query_execute (query.get (), stack.get (),
-				   zw_throw_on_error {})};
-
-	    uint64_t count = 0;
-	    while (auto out = zw_result_next (*result))
-	      {
-		// grep: Exit immediately with zero status if any match
-		// is found, even if an error was detected.
-		if (verbosity < 0)
-		  return 0;
-
-		zw_stack &stk = *out.get ();
-		match = true;
-		if (! show_count)
-		  {
-		    if (with_header)
-		      std::cout << header << ":\n";
-		    if (zw_stack_depth (&stk) > 1)
-		      std::cout << "---\n";
-		    for (size_t i = 0, n = zw_stack_depth (&stk);
-			 i < n; ++i)
-		      {
-			auto const *val = zw_stack_at (&stk, i);
-			assert (val != nullptr);
-			dump.dump_value (std::cout, *val,
-					 dumper::format::full);
-			std::cout << std::endl;
-		      }
-		  }
-		else
-		  ++count;
-	      }
-
-	    if (show_count)
-	      {
-		if (with_header)
-		  std::cout << header << ":";
-		std::cout << std::dec << count << std::endl;
-	      }
-	  }
-	catch (std::runtime_error const &e)
-	  {
-	    error_message (no_messages, verbosity, errors)
-	      << "dwgrep: " << header << ": " << e.what () << std::endl;
-	  }
-	catch (...)
-	  {
-	    error_message (no_messages, verbosity, errors)
-	      << "dwgrep: " << header << ": Unknown error" << std::endl;
-	  }
+	jobs = std::min (jobs, max_open_files);
+	zw_dwarf_cache_set_size (0);
+      }
 
-	// Bump argument list.
-	bool next = false;
-	for (size_t ri = 0; ri < args.size (); ++ri)
-	  {
-	    size_t i = args.size () - 1 - ri;
-	    if (++arg_its[i] == args[i].end ())
-	      arg_its[i] = args[i].begin ();
-	    else
-	      {
-		next = true;
-		break;
-	      }
-	  }
-	if (! next)
+    if (jobs > 1)
+      for (auto const &arg: args)
+	for (auto const &val: arg)
+	  if (! is_thread_safe (*val))
+	    jobs = 1;
+
+    // A single file can be split by units, if the query allows it, and
+    // the order of results doesn't matter.
+    bool split = jobs > 1 && iterations == 1 && opts.have_files
+      && (unordered_output || show_count || verbosity < 0)
+      && zw_query_splits_over_units (voc.get (), query.get ());
+
+    // Results are dumped to a large buffer, unless someone is watching.
+    std::unique_ptr <stdout_buffer> outbuf;
+    if (! interactive)
+      outbuf = std::make_unique <stdout_buffer> (1 << 18);
+
+    run_status status;
+    if (split)
+      status = run_split (*voc, *query, files[0], args, opts, no_messages,
+			  jobs);
+    else if (jobs > 1 && units > 1)
+      status = run_parallel (*voc, *query, files, args, units, opts,
+			     no_messages, jobs, unordered_output);
+    else
+      for (size_t u = 0; u < units; ++u)
+	if (! run_unit (*voc, *query, files, args, u, opts,
+			std::cout, error_message (no_messages), status))
 	  break;
+
+    if (explain_run)
+      {
+	std::cout.flush ();
+	dump_plan (std::cerr, true);
       }
 
-    if (errors)
+    if (verbosity < 0 && status.match)
+      return 0;
+
+    if (status.errors)
 	return 2;
 
-    return match ? 0 : 1;
+    return status.match ? 0 : 1;
   }
 catch (std::runtime_error const& e)
   {
@@ -55,7 +55,8 @@ merge_options (std::vector <ext_option> const &ext_opts)
   return opts;
 }
 
-ext_shopt help, version, longarg;
+ext_shopt help, version, longarg, unordered, index_dir, max_open, output,
+  explain, explain_analyze;
 
 std::vector <ext_option> ext_options = {
   {'q', "silent", ext_argument::no, ""},
@@ -112,6 +113,116 @@ std::vector <ext_option> ext_options = {
 	file is read and run over the input file(s).  At most one
 	``-e`` or ``-f`` option shall be present.
 
+)docstring"},
+
+  {'j', "jobs", ext_argument::required ("N"), R"docstring(
+
+	Run queries on up to *N* threads in parallel.  Each file given
+	on the command line is processed by a single thread, and output
+	is shown in the same order as without this option.  When *N* is
+	0, the number of available processors is used.
+
+	When a single file is given, the query starts with ``unit`` or
+	``entry``, and the order of results doesn't matter (i.e. with
+	``--unordered``, ``-c`` or ``-q``), the units of that file are
+	split among the threads instead.  Positions of values that these
+	words yield then only count within one thread.
+
+	Arguments that refer to Dwarf files, other than the files given
+	on the command line themselves, can't be shared across threads.
+	When such arguments are passed, the files are processed
+	serially.
+
+)docstring"},
+
+  {unordered, "unordered", ext_argument::no, R"docstring(
+
+	With ``-j``, show output of each file as soon as it has been
+	processed, instead of in the order that the files were given.
+	With a single file, this allows splitting its units among the
+	threads.
+
+)docstring"},
+
+  {max_open, "max-open", ext_argument::required ("N"), R"docstring(
+
+	Keep at most *N* of the files given on the command line open at
+	any one time.  Files are opened when the query gets to them and
+	closed as soon as it's done with them, so each job (see ``-j``)
+	holds at most one file open, and this option limits the number
+	of jobs to *N*.
+
+)docstring"},
+
+  {output, "format", ext_argument::required ("FMT"), R"docstring(
+
+	Write results in format *FMT*, which is one of ``text`` (the
+	default), ``jsonl`` or ``binary``.
+
+	With ``jsonl``, each result is written as a JSON object on a
+	line of its own.  Its field ``values`` holds the stack of the
+	result, TOS first.  Strings and sequences are written as
+	JSON strings and arrays.  Other values are objects, whose field
+	``type`` holds the name of the value type.  Constants have
+	fields ``value`` and ``text``, Dwarf values have ``name``, CU's
+	have ``offset``, DIE's have ``offset``, ``tag``, ``cu`` (the
+	offset of the CU DIE) and ``file``, and attributes have
+	``name`` and ``values``.  DIE's on top level of the result also
+	have ``attributes``, a list of objects with fields ``name`` and
+	``values``.  Remaining values have ``text``, their textual
+	rendering.  When file names are shown (see ``-H``), the result
+	also has a field ``input``.  With ``-c``, the count is written
+	in a field ``count``.
+
+	With ``binary``, each result is written as a record, which is
+	prefixed by its length.  Integers are little-endian, strings
+	are prefixed by their length as a 4-byte integer.  A record
+	starts with a byte ``r`` (a result) or ``c`` (a count),
+	followed by the file name (empty if not shown).  Results then
+	have a 4-byte number of values and the values, a count has an
+	8-byte count.  Each value starts with a byte that identifies
+	its type, followed by the same fields as with ``jsonl``, in
+	this order: ``i`` constant (a byte that is 1 for signed and 0
+	for unsigned constants, 8-byte value, two's complement if
+	signed, text), ``s`` string, ``q`` sequence (4-byte length, values),
+	``f`` Dwarf (name), ``u`` CU (8-byte offset), ``d`` DIE
+	(8-byte offset, 8-byte CU offset, tag, file, 4-byte number of
+	attributes and attributes), ``a`` attribute, ``x`` anything
+	else (text).  An attribute is its name, a 4-byte number of
+	values and the values.
+
+)docstring"},
+
+  {index_dir, "index-dir", ext_argument::required ("DIR"), R"docstring(
+
+	Keep indices of the searched files in *DIR*.  The first time a
+	file is searched, an index of its DIE's is built and saved
+	there, and later searches of the same file load the index
+	instead of walking the file's debug info again.  This speeds up
+	words such as ``parent`` and ``?root``.  Indices are keyed on
+	build ID, and are rebuilt when the file changes.  Files without
+	a build ID are not indexed.
+
+)docstring"},
+
+  {explain, "explain", ext_argument::no, R"docstring(
+
+	Show the ops that the query is built of and exit without running
+	it.  Each op is on a line of its own, and ops that run
+	sub-expressions are followed by the ops of those
+	sub-expressions, indented.
+
+)docstring"},
+
+  {explain_analyze, "explain-analyze", ext_argument::no, R"docstring(
+
+	Run the query as usual, then write the ops that it is built of
+	to standard error, like ``--explain`` does.  Each op is shown
+	with the number of stacks that got in (when the op that
+	feeds it is shown as well) and out of it, how many times it was
+	asked for a stack, and time spent in it.  That time includes
+	time spent in ops that feed it.
+
 )docstring"},
 
   {help, "help", ext_argument::no, R"docstring(
@@ -0,0 +1,194 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <dwarf.h>
+
+#include "addr_index.hh"
+#include "dwit.hh"
+#include "dwpp.hh"
+
+void
+addr_index::range_set::add (Dwarf_Die die)
+{
+  Dwarf_Addr base;
+  for (ptrdiff_t off = 0;;)
+    {
+      Dwarf_Addr start, end;
+      off = dwarf_ranges (&die, off, &base, &start, &end);
+      if (off < 0)
+	throw_libdw ();
+      if (off == 0)
+	break;
+
+      if (start < end)
+	m_ranges.push_back ({start, end, dwarf_cu_getdwarf (die.cu),
+			     dwarf_dieoffset (&die)});
+    }
+}
+
+Dwarf_Addr
+addr_index::range_set::seal (size_t lo, size_t hi)
+{
+  if (lo == hi)
+    return 0;
+
+  size_t mid = lo + (hi - lo) / 2;
+  Dwarf_Addr high = std::max (seal (lo, mid), seal (mid + 1, hi));
+  return m_max_high[mid] = std::max (high, m_ranges[mid].high);
+}
+
+void
+addr_index::range_set::seal ()
+{
+  std::sort (m_ranges.begin (), m_ranges.end (),
+	     [] (range const &a, range const &b)
+	     {
+	       return a.low < b.low;
+	     });
+
+  m_max_high.assign (m_ranges.size (), 0);
+  seal (0, m_ranges.size ());
+}
+
+void
+addr_index::range_set::find (Dwarf_Addr addr, size_t lo, size_t hi,
+			     std::vector <range> &ret) const
+{
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (m_max_high[mid] <= addr)
+	return;
+
+      find (addr, lo, mid, ret);
+
+      // Ranges in the right subtree start even higher.
+      range const &r = m_ranges[mid];
+      if (r.low > addr)
+	return;
+      if (r.high > addr)
+	ret.push_back (r);
+
+      lo = mid + 1;
+    }
+}
+
+std::vector <addr_index::range>
+addr_index::range_set::find (Dwarf_Addr addr) const
+{
+  std::vector <range> ret;
+  find (addr, 0, m_ranges.size (), ret);
+
+  // A DIE may have several ranges, but those shouldn't overlap.
+  // Order the DIE's by offset.
+  std::sort (ret.begin (), ret.end (),
+	     [] (range const &a, range const &b)
+	     {
+	       return std::make_pair (a.dw, a.off) < std::make_pair (b.dw, b.off);
+	     });
+  return ret;
+}
+
+addr_index::addr_index (std::vector <Dwarf *> const &dwarfs)
+{
+  for (Dwarf *dw: dwarfs)
+    for (cu_iterator it {dw}; it != cu_iterator::end (); ++it)
+      m_units.add (**it);
+  m_units.seal ();
+}
+
+addr_index::range_set const &
+addr_index::subprograms (Dwarf_Die cudie)
+{
+  auto key = std::make_pair (dwarf_cu_getdwarf (cudie.cu),
+			     dwarf_dieoffset (&cudie));
+  auto it = m_subprograms.find (key);
+  if (it != m_subprograms.end ())
+    return it->second;
+
+  range_set &ret = m_subprograms[key];
+
+  // Subprograms can be nested in namespaces, classes and the like, so
+  // look through the whole unit, but don't descend into the
+  // subprograms themselves.
+  std::vector <Dwarf_Die> stack {cudie};
+  while (! stack.empty ())
+    {
+      Dwarf_Die die = stack.back ();
+      stack.pop_back ();
+
+      for (child_iterator jt {die}; jt != child_iterator::end (); ++jt)
+	if (dwarf_tag (*jt) == DW_TAG_subprogram)
+	  ret.add (**jt);
+	else if (dwarf_haschildren (*jt))
+	  stack.push_back (**jt);
+    }
+
+  ret.seal ();
+  return ret;
+}
+
+std::vector <Dwarf_Die>
+addr_index::find_scopes (Dwarf_Addr addr)
+{
+  std::vector <Dwarf_Die> ret;
+  for (auto const &u: m_units.find (addr))
+    {
+      Dwarf_Die cudie;
+      if (dwarf_offdie (u.dw, u.off, &cudie) == nullptr)
+	throw_libdw ();
+
+      for (auto const &s: subprograms (cudie).find (addr))
+	{
+	  Dwarf_Die die;
+	  if (dwarf_offdie (s.dw, s.off, &die) == nullptr)
+	    throw_libdw ();
+
+	  std::vector <Dwarf_Die> chain {die};
+	  for (bool found = true; found; )
+	    {
+	      found = false;
+	      for (child_iterator jt {chain.back ()};
+		   jt != child_iterator::end (); ++jt)
+		if (dwarf_haspc (*jt, addr) > 0)
+		  {
+		    chain.push_back (**jt);
+		    found = true;
+		    break;
+		  }
+	    }
+
+	  ret.insert (ret.end (), chain.rbegin (), chain.rend ());
+	}
+
+      ret.push_back (cudie);
+    }
+
+  return ret;
+}
@@ -0,0 +1,92 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _ADDR_INDEX_H_
+#define _ADDR_INDEX_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <elfutils/libdw.h>
+
+// An index for mapping addresses to DIE's whose code covers them.  It
+// is built once per Dwarf context from the ranges of unit DIE's.  Ranges
+// of subprograms of a given unit are indexed the first time that an
+// address falls into that unit.  Scopes nested in a subprogram
+// (inlined subroutines, lexical blocks) are found by descending from
+// the subprogram.
+class addr_index
+{
+  struct range
+  {
+    Dwarf_Addr low;
+    Dwarf_Addr high;
+    Dwarf *dw;
+    Dwarf_Off off;
+  };
+
+  class range_set
+  {
+    // Ranges sorted by their low end.  They are viewed as a balanced
+    // binary search tree: the root of the tree over [LO, HI) is the
+    // range in the middle, and its subtrees are the halves on either
+    // side.
+    std::vector <range> m_ranges;
+
+    // The highest end among ranges in the subtree rooted at a given
+    // range.  Lookups skip subtrees where no range reaches the
+    // address, which keeps them logarithmic even when ranges nest
+    // or overlap.
+    std::vector <Dwarf_Addr> m_max_high;
+
+    Dwarf_Addr seal (size_t lo, size_t hi);
+    void find (Dwarf_Addr addr, size_t lo, size_t hi,
+	       std::vector <range> &ret) const;
+
+  public:
+    void add (Dwarf_Die die);
+    void seal ();
+    std::vector <range> find (Dwarf_Addr addr) const;
+  };
+
+  range_set m_units;
+  std::map <std::pair <Dwarf *, Dwarf_Off>, range_set> m_subprograms;
+
+  range_set const &subprograms (Dwarf_Die cudie);
+
+public:
+  explicit addr_index (std::vector <Dwarf *> const &dwarfs);
+
+  // Find scopes that cover ADDR.  For each unit that covers ADDR (in
+  // order of offset), and for each subprogram of that unit that covers
+  // ADDR, the chain of scopes is stored, innermost first.  The unit DIE
+  // comes last.
+  std::vector <Dwarf_Die> find_scopes (Dwarf_Addr addr);
+};
+
+#endif /* _ADDR_INDEX_H_ */
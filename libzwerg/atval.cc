@@ -1055,3 +1055,64 @@ dwop_number2 (std::shared_ptr <dwfl_context> dwctx,
 {
   return locexpr_op_values <1> (dwctx, attr, op);
 }
+
+bool
+at_value_exists (std::shared_ptr <dwfl_context> dwctx,
+		 value_die const &vd, Dwarf_Attribute attr)
+{
+  bool is_location = false;
+  switch (dwarf_whatform (&attr))
+    {
+    case DW_FORM_exprloc:
+      is_location = true;
+      break;
+
+    case DW_FORM_data1:
+    case DW_FORM_data2:
+    case DW_FORM_data4:
+    case DW_FORM_data8:
+    case DW_FORM_sec_offset:
+    case DW_FORM_block1:
+    case DW_FORM_block2:
+    case DW_FORM_block4:
+    case DW_FORM_block:
+      // These are location expressions, or lists thereof, as far as
+      // handle_at_dependent_value is concerned.
+      switch (dwarf_whatattr (&attr))
+	{
+	case DW_AT_data_member_location:
+	case DW_AT_data_location:
+	case DW_AT_frame_base:
+	case DW_AT_location:
+	case DW_AT_return_addr:
+	case DW_AT_segment:
+	case DW_AT_static_link:
+	case DW_AT_use_location:
+	case DW_AT_vtable_elem_location:
+	  is_location = true;
+	}
+      break;
+    }
+
+  if (is_location)
+    {
+      // Like the first step of locexpr_producer, but without building
+      // the value_loclist_elem.
+      Dwarf_Addr base, start, end;
+      Dwarf_Op *expr;
+      size_t exprlen;
+      switch (dwarf_getlocations (&attr, 0, &base, &start, &end,
+				  &expr, &exprlen))
+	{
+	case -1:
+	  throw_libdw ();
+	case 0:
+	  return false;
+	default:
+	  return true;
+	}
+    }
+
+  auto prod = at_value (dwctx, vd, attr);
+  return prod != nullptr && prod->next () != nullptr;
+}
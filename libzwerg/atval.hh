@@ -40,6 +40,11 @@ std::unique_ptr <value_producer <value>>
 at_value (std::shared_ptr <dwfl_context> dwctx,
 	  value_die const &die, Dwarf_Attribute attr);
 
+// Whether at_value would yield anything for ATTR at DIE.  Location
+// attributes are answered without decoding the expressions.
+bool at_value_exists (std::shared_ptr <dwfl_context> dwctx,
+		      value_die const &die, Dwarf_Attribute attr);
+
 // Obtain DIE's ranges.
 value_aset die_ranges (Dwarf_Die die);
 
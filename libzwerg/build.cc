@@ -32,49 +32,203 @@
 #include <memory>
 
 #include "op.hh"
+#include "overload.hh"
+#include "plan.hh"
+#include "stack_profile.hh"
 #include "tree.hh"
+#include "value-closure.hh"
 #include "value-cst.hh"
 #include "value-seq.hh"
 #include "value-str.hh"
+#include "builtin-agg.hh"
 #include "builtin-closure.hh"
+#include "builtin-cmp.hh"
 #include "bindings.hh"
 
 namespace
 {
+  // Find an overload in TAB that all stacks of profile SP select.
+  // Update SP with the stack effect of the word, as far as it can be
+  // determined, and record the outcome in STATS.  Returns nullptr if
+  // the overload has to be looked up at runtime.
+  builtin const *
+  peg_overload (overload_tab const &tab, stack_profile &sp,
+		build_stats &stats)
+  {
+    // Overloads are tried in order, and the first one that matches
+    // wins.  The word can be pegged if the first overload that may
+    // match is certain to match.
+    builtin const *pegged = nullptr;
+    std::vector <builtin_protomap> effects;
+    for (auto const &ovl: tab.get_overloads ())
+      if (sp.may_match (std::get <0> (ovl)))
+	{
+	  effects.push_back (std::get <1> (ovl)->protomap ());
+	  if (sp.must_match (std::get <0> (ovl)))
+	    {
+	      if (effects.size () == 1)
+		pegged = std::get <1> (ovl).get ();
+	      break;
+	    }
+	}
+
+    // If all overloads that may be selected have the same effect, the
+    // result is known even if the overload itself isn't.  Failing
+    // that, if they at least take and leave the same number of
+    // values, the stack height is still known.
+    auto same_depth = [&effects] (builtin_protomap const &pm)
+      {
+	if (pm.size () != 1)
+	  return false;
+	auto const &a = pm.front ();
+	auto const &b = effects.front ().front ();
+	return std::get <0> (a).size () == std::get <0> (b).size ()
+	  && ((std::get <1> (a) == yield::pred)
+	      == (std::get <1> (b) == yield::pred))
+	  && std::get <2> (a).size () == std::get <2> (b).size ();
+      };
+    if (effects.empty () || effects.front ().size () != 1)
+      sp.clear ();
+    else if (std::all_of (effects.begin (), effects.end (),
+			  [&effects] (builtin_protomap const &pm)
+			  { return pm == effects.front (); }))
+      sp.apply (effects.front ().front ());
+    else if (std::all_of (effects.begin (), effects.end (), same_depth))
+      sp.apply_depth (effects.front ().front ());
+    else
+      sp.clear ();
+
+    if (pegged != nullptr)
+      ++stats.pegged;
+    else
+      ++stats.dispatched;
+    return pegged;
+  }
+
+  // Profile for the body of a transitive closure that is entered with
+  // stacks of profile SP.  Types vary from iteration to iteration, but
+  // the height can be tracked through the first one.
+  stack_profile
+  closure_body_profile (stack_profile const &sp)
+  {
+    stack_profile ret = sp;
+    ret.clear_types ();
+    return ret;
+  }
+
+  // If the body of a transitive closure doesn't keep the stack height,
+  // later iterations run on stacks of different height than the first
+  // one, and what they need is not known.
+  void
+  check_closure_height (stack_profile const &entry_sp,
+			stack_profile const &body_sp, build_stats &stats)
+  {
+    if (! entry_sp.height_known () || ! body_sp.height_known ()
+	|| entry_sp.height () != body_sp.height ())
+      stats.stack_need_known = false;
+  }
+
   std::shared_ptr <op>
   build_exec (tree const &t, layout &l, layout::loc rdv_ll,
 	      std::shared_ptr <op> upstream,
-	      bindings &bn, uprefs &up);
+	      bindings &bn, uprefs &up, stack_profile &sp, build_stats &stats);
+
+  // Build sub-expression T on top of ORIGIN.  The sub-expression is
+  // entered with stacks of profile SP, and SUB_SP is set to the
+  // profile of stacks that it yields.  The caller pops POPS values
+  // off each of those.  NEED is set to how many values near TOS of
+  // the entry stack the sub-expression and the caller look at, or to
+  // op_origin::whole_stack if that isn't known.
+  std::shared_ptr <op>
+  build_subexpr (tree const &t, layout &l, layout::loc rdv_ll,
+		 std::shared_ptr <op_origin> origin,
+		 bindings &bn, uprefs &up,
+		 stack_profile const &sp, stack_profile &sub_sp,
+		 build_stats &stats, size_t pops, size_t &need)
+  {
+    build_stats sub_stats = stats;
+    sub_stats.stack_need = 0;
+    sub_stats.stack_need_known = true;
+    sub_sp = sp.rebase (sub_stats);
+    auto op = build_exec (t, l, rdv_ll, origin, bn, up, sub_sp, sub_stats);
+
+    stats.pegged = sub_stats.pegged;
+    stats.dispatched = sub_stats.dispatched;
+    stats.followed = sub_stats.followed;
+    stats.fused = sub_stats.fused;
+
+    stack_profile entry_sp = sp;
+    if (! sub_stats.stack_need_known || ! sub_sp.height_known ())
+      {
+	entry_sp.require_all ();
+	need = op_origin::whole_stack;
+	return op;
+      }
+
+    need = sub_stats.stack_need;
+    if (sub_sp.height () < (int) pops)
+      need = std::max (need, (size_t) ((int) pops - sub_sp.height ()));
+    entry_sp.require (need);
+    return op;
+  }
+
+  // Build a pred for BI, or return nullptr if BI is not a predicate.
+  std::unique_ptr <pred>
+  build_builtin_pred (builtin const &bi, layout &l,
+		      stack_profile const &sp, build_stats &stats)
+  {
+    if (auto obi = dynamic_cast <overloaded_pred_builtin const *> (&bi))
+      {
+	// Predicates don't change the stack.
+	stack_profile tmp = sp;
+	if (auto ovl = peg_overload (*obi->get_overload_tab (), tmp, stats))
+	  return maybe_invert (ovl->build_pred (l), obi->m_positive);
+	return bi.build_pred (l);
+      }
+
+    auto pred = bi.build_pred (l);
+    if (pred != nullptr)
+      {
+	stack_profile tmp = sp;
+	bi.stack_effect (tmp);
+      }
+    return pred;
+  }
 
   std::unique_ptr <pred>
   build_pred (tree const &t, layout &l, layout::loc rdv_ll,
-	      bindings &bn, uprefs &up)
+	      bindings &bn, uprefs &up,
+	      stack_profile const &sp, build_stats &stats)
   {
     switch (t.m_tt)
       {
       case tree_type::PRED_NOT:
-	return std::make_unique <pred_not> (build_pred (t.child (0), l, rdv_ll, bn, up));
+	return std::make_unique <pred_not>
+	  (build_pred (t.child (0), l, rdv_ll, bn, up, sp, stats));
 
       case tree_type::PRED_OR:
 	return std::make_unique <pred_or>
-	  (build_pred (t.m_children[0], l, rdv_ll, bn, up),
-	   build_pred (t.m_children[1], l, rdv_ll, bn, up));
+	  (build_pred (t.m_children[0], l, rdv_ll, bn, up, sp, stats),
+	   build_pred (t.m_children[1], l, rdv_ll, bn, up, sp, stats));
 
       case tree_type::PRED_AND:
 	return std::make_unique <pred_and>
-	  (build_pred (t.m_children[0], l, rdv_ll, bn, up),
-	   build_pred (t.m_children[1], l, rdv_ll, bn, up));
+	  (build_pred (t.m_children[0], l, rdv_ll, bn, up, sp, stats),
+	   build_pred (t.m_children[1], l, rdv_ll, bn, up, sp, stats));
 
       case tree_type::PRED_SUBX_ANY:
 	{
 	  assert (t.m_children.size () == 1);
 	  auto origin = std::make_shared <op_origin> (l);
-	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up);
-	  return std::make_unique <pred_subx_any> (op, origin);
+	  stack_profile sub_sp;
+	  size_t need;
+	  auto op = build_subexpr (t.child (0), l, rdv_ll, origin, bn, up,
+				   sp, sub_sp, stats, 0, need);
+	  return std::make_unique <pred_subx_any> (op, origin, need);
 	}
 
       case tree_type::F_BUILTIN:
-	return t.m_builtin->build_pred (l);
+	return build_builtin_pred (*t.m_builtin, l, sp, stats);
 
       case tree_type::CAT:
       case tree_type::NOP:
@@ -104,51 +258,257 @@ namespace
   std::shared_ptr <op>
   build_builtin (builtin const &bi,
 		 std::shared_ptr <op> upstream,
-		 layout &l)
+		 layout &l, stack_profile &sp, build_stats &stats,
+		 std::vector <builtin const *> const &next = {})
   {
-    if (auto pred = bi.build_pred (l))
+    if (auto pred = build_builtin_pred (bi, l, sp, stats))
       return std::make_shared <op_assert> (upstream, std::move (pred));
 
-    auto op = bi.build_exec (l, upstream);
+    if (auto obi = dynamic_cast <overloaded_op_builtin const *> (&bi))
+      {
+	auto tab = obi->get_overload_tab_followed (next);
+	if (tab != obi->get_overload_tab ())
+	  ++stats.followed;
+	if (auto ovl = peg_overload (*tab, sp, stats))
+	  {
+	    auto op = ovl->build_exec (l, upstream);
+	    assert (op != nullptr);
+	    return op;
+	  }
+      }
+    else
+      bi.stack_effect (sp);
+
+    auto op = bi.build_exec_followed (l, upstream, next);
     assert (op != nullptr);
     return op;
   }
 
+  // If T is a word that refers to a builtin, return that builtin.
+  builtin const *
+  find_builtin (tree const &t, bindings &bn, uprefs &up)
+  {
+    if (t.m_tt == tree_type::F_BUILTIN)
+      return t.m_builtin.get ();
+    if (t.m_tt != tree_type::READ)
+      return nullptr;
+
+    if (const binding *b = bn.find (t.str ()))
+      return b->is_builtin () ? &b->get_builtin () : nullptr;
+    if (upref *upr = up.find (t.str ()))
+      return upr->is_builtin () ? &upr->get_builtin () : nullptr;
+    return nullptr;
+  }
+
+  // Recognize ?(WORD == "STR") and (WORD == "STR"), or the same with
+  // operands swapped.  The parser expands the comparison to:
+  //
+  //   (SCOPE (CAT (SUBX_EVAL<1> (SCOPE A)) (BIND<~a~>)
+  //		   (SUBX_EVAL<1> (SCOPE B)) (BIND<~b~>)
+  //		   (READ<~a~>) (READ<~b~>) (READ<==>)))
+  //
+  // ... wrapped in one or two (ASSERT (PRED_SUBX_ANY X)).
+  std::unique_ptr <str_eq_assertion>
+  match_str_eq (tree const &t, bindings &bn, uprefs &up)
+  {
+    tree const *u = &t;
+    if (u->m_tt != tree_type::ASSERT)
+      return nullptr;
+    while (u->m_tt == tree_type::ASSERT
+	   && u->child (0).m_tt == tree_type::PRED_SUBX_ANY)
+      u = &u->child (0).child (0);
+    if (u->m_tt != tree_type::SCOPE)
+      return nullptr;
+
+    auto const &cat = u->child (0);
+    auto is_word = [&cat] (size_t i, tree_type tt, char const *str)
+      {
+	return cat.child (i).m_tt == tt && cat.child (i).str () == str;
+      };
+    auto operand = [&cat] (size_t i) -> tree const *
+      {
+	auto const &ch = cat.child (i);
+	if (ch.m_tt == tree_type::SUBX_EVAL && ch.cst ().value () == 1
+	    && ch.child (0).m_tt == tree_type::SCOPE)
+	  return &ch.child (0).child (0);
+	return nullptr;
+      };
+
+    if (cat.m_tt != tree_type::CAT || cat.m_children.size () != 7
+	|| ! is_word (1, tree_type::BIND, "~a~")
+	|| ! is_word (3, tree_type::BIND, "~b~")
+	|| ! is_word (4, tree_type::READ, "~a~")
+	|| ! is_word (5, tree_type::READ, "~b~"))
+      return nullptr;
+
+    auto eq = dynamic_cast <builtin_eq const *>
+      (find_builtin (cat.child (6), bn, up));
+    tree const *a = operand (0);
+    tree const *b = operand (2);
+    if (eq == nullptr || ! eq->is_positive ()
+	|| a == nullptr || b == nullptr)
+      return nullptr;
+
+    if (a->m_tt == tree_type::STR)
+      std::swap (a, b);
+    if (b->m_tt != tree_type::STR)
+      return nullptr;
+
+    if (builtin const *word = find_builtin (*a, bn, up))
+      return std::make_unique <str_eq_assertion> (*word, b->str ());
+    return nullptr;
+  }
+
+  // Collect builtins that immediately follow the I-th child of T.
+  // Assertions that match_str_eq recognizes are described by
+  // str_eq_assertion's, which are kept in KEEP.
+  std::vector <builtin const *>
+  following_builtins (tree const &t, size_t i, bindings &bn, uprefs &up,
+		      std::vector <std::unique_ptr <str_eq_assertion>> &keep)
+  {
+    std::vector <builtin const *> ret;
+    for (size_t j = i + 1; j < t.m_children.size (); ++j)
+      if (builtin const *bi = find_builtin (t.child (j), bn, up))
+	ret.push_back (bi);
+      else if (auto sea = match_str_eq (t.child (j), bn, up))
+	{
+	  keep.push_back (std::move (sea));
+	  ret.push_back (keep.back ().get ());
+	}
+      else
+	break;
+    return ret;
+  }
+
+  // If the I-th child of T is a capture followed by a word whose
+  // overload for sequences aggregates them, and stacks of profile SP
+  // with a sequence pushed are certain to select that overload,
+  // return the overload.
+  aggregate_overload const *
+  find_capture_aggregate (tree const &t, size_t i, bindings &bn, uprefs &up,
+			  stack_profile sp)
+  {
+    if (t.child (i).m_tt != tree_type::CAPTURE
+	|| i + 1 >= t.m_children.size ())
+      return nullptr;
+
+    auto obi = dynamic_cast <overloaded_op_builtin const *>
+      (find_builtin (t.child (i + 1), bn, up));
+    if (obi == nullptr)
+      return nullptr;
+
+    sp.push (value_seq::vtype);
+    for (auto const &ovl: obi->get_overload_tab ()->get_overloads ())
+      if (sp.may_match (std::get <0> (ovl)))
+	{
+	  if (! sp.must_match (std::get <0> (ovl)))
+	    return nullptr;
+	  return dynamic_cast <aggregate_overload const *>
+	    (std::get <1> (ovl).get ());
+	}
+
+    return nullptr;
+  }
+
+  // Call BUILD to build an op on top of UPSTREAM.  If a plan is being
+  // collected, register the op there.
+  template <class Build>
   std::shared_ptr <op>
-  build_exec (tree const &t, layout &l, layout::loc rdv_ll,
-	      std::shared_ptr <op> upstream,
-	      bindings &bn, uprefs &up)
+  build_planned (layout &l, std::shared_ptr <op> upstream,
+		 build_stats &stats, Build build)
+  {
+    if (stats.plan == nullptr)
+      return build ();
+
+    size_t idx = stats.plan->open ();
+    auto op = build ();
+    return stats.plan->close (idx, l, upstream, op);
+  }
+
+  std::shared_ptr <op>
+  build_node_exec (tree const &t, layout &l, layout::loc rdv_ll,
+		   std::shared_ptr <op> upstream,
+		   bindings &bn, uprefs &up, stack_profile &sp,
+		   build_stats &stats)
   {
     switch (t.m_tt)
       {
       case tree_type::CAT:
-	for (auto const &ch: t.m_children)
-	  upstream = build_exec (ch, l, rdv_ll, upstream, bn, up);
+	for (size_t i = 0; i < t.m_children.size (); ++i)
+	  if (auto agg = find_capture_aggregate (t, i, bn, up, sp))
+	    {
+	      // [A] WORD, where WORD aggregates the sequence.  Feed what
+	      // A yields to the aggregator directly.
+	      tree const &capture = t.child (i++);
+	      upstream = build_planned
+		(l, upstream, stats, [&] ()
+		 {
+		   auto origin = std::make_shared <op_origin> (l);
+		   stack_profile sub_sp;
+		   size_t need;
+		   auto op = build_subexpr (capture.child (0), l, rdv_ll,
+					    origin, bn, up, sp, sub_sp, stats,
+					    1, need);
+		   sp.push (value_seq::vtype);
+		   sp.apply (agg->protomap ().front ());
+		   ++stats.pegged;
+		   ++stats.fused;
+		   return agg->build_capture (upstream, origin, op, need);
+		 });
+	    }
+	  else if (builtin const *bi = find_builtin (t.child (i), bn, up))
+	    upstream = build_planned
+	      (l, upstream, stats, [&] ()
+	       {
+		 std::vector <std::unique_ptr <str_eq_assertion>> keep;
+		 return build_builtin (*bi, upstream, l, sp, stats,
+				       following_builtins (t, i, bn, up,
+							   keep));
+	       });
+	  else
+	    upstream = build_exec (t.child (i), l, rdv_ll, upstream, bn, up,
+				   sp, stats);
 	return upstream;
 
       case tree_type::ALT:
 	{
 	  auto merge = std::make_shared <op_merge> (l, upstream);
 
+	  stack_profile out_sp;
 	  for (size_t i = 0; i < t.m_children.size (); ++i)
 	    {
 	      auto tine = std::make_shared <op_tine> (*merge, i);
-	      auto op = build_exec (t.m_children[i], l, rdv_ll, tine, bn, up);
+	      stack_profile branch_sp = sp;
+	      auto op = build_exec (t.m_children[i], l, rdv_ll, tine, bn, up,
+				    branch_sp, stats);
 	      merge->add_branch (op);
+	      if (i == 0)
+		out_sp = branch_sp;
+	      else
+		out_sp.join (branch_sp);
 	    }
 
+	  sp = out_sp;
 	  return merge;
 	}
 
       case tree_type::OR:
 	{
 	  auto o = std::make_shared <op_or> (l, upstream);
-	  for (auto const &ch: t.m_children)
+	  stack_profile out_sp;
+	  for (size_t i = 0; i < t.m_children.size (); ++i)
 	    {
 	      auto origin2 = std::make_shared <op_origin> (l);
-	      auto op = build_exec (ch, l, rdv_ll, origin2, bn, up);
+	      stack_profile branch_sp = sp;
+	      auto op = build_exec (t.child (i), l, rdv_ll, origin2, bn, up,
+				    branch_sp, stats);
 	      o->add_branch (origin2, op);
+	      if (i == 0)
+		out_sp = branch_sp;
+	      else
+		out_sp.join (branch_sp);
 	    }
+	  sp = out_sp;
 	  return o;
 	}
 
@@ -156,17 +516,11 @@ namespace
 	return std::make_shared <op_nop> (upstream);
 
       case tree_type::F_BUILTIN:
-	{
-	  if (auto pred = build_pred (t, l, rdv_ll, bn, up))
-	    return std::make_shared <op_assert> (upstream, std::move (pred));
-	  auto op = t.m_builtin->build_exec (l, upstream);
-	  assert (op != nullptr);
-	  return op;
-	}
+	return build_builtin (*t.m_builtin, upstream, l, sp, stats);
 
       case tree_type::ASSERT:
 	return std::make_shared <op_assert>
-	  (upstream, build_pred (t.child (0), l, rdv_ll, bn, up));
+	  (upstream, build_pred (t.child (0), l, rdv_ll, bn, up, sp, stats));
 
       case tree_type::FORMAT:
 	{
@@ -180,53 +534,79 @@ namespace
 		strgr = std::make_shared <stringer_lit> (strgr, tree.str ());
 	      else
 		{
+		  // The stack flows from one sub-expression to the next,
+		  // each of which leaves a value to be shown on top.
 		  auto origin2 = std::make_shared <op_origin> (l);
-		  auto op = build_exec (tree, l, rdv_ll, origin2, bn, up);
+		  auto op = build_exec (tree, l, rdv_ll, origin2, bn, up,
+					sp, stats);
+		  sp.pop (1);
 		  strgr = std::make_shared <stringer_op> (l, strgr,
 							  origin2, op);
 		}
 	    }
 
+	  sp.push (value_str::vtype);
 	  return std::make_shared <op_format> (l, upstream, s_origin, strgr);
 	}
 
       case tree_type::CONST:
 	{
 	  auto val = std::make_unique <value_cst> (t.cst (), 0);
+	  sp.push (value_cst::vtype);
 	  return std::make_shared <op_const> (upstream, std::move (val));
 	}
 
       case tree_type::STR:
 	{
 	  auto val = std::make_unique <value_str> (std::string (t.str ()), 0);
+	  sp.push (value_str::vtype);
 	  return std::make_shared <op_const> (upstream, std::move (val));
 	}
 
       case tree_type::EMPTY_LIST:
 	{
 	  auto val = std::make_unique <value_seq> (value_seq::seq_t {}, 0);
+	  sp.push (value_seq::vtype);
 	  return std::make_shared <op_const> (upstream, std::move (val));
 	}
 
       case tree_type::CAPTURE:
 	{
 	  auto origin = std::make_shared <op_origin> (l);
-	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up);
-	  return std::make_shared <op_capture> (upstream, origin, op);
+	  stack_profile sub_sp;
+	  size_t need;
+	  auto op = build_subexpr (t.child (0), l, rdv_ll, origin, bn, up,
+				   sp, sub_sp, stats, 1, need);
+	  sp.push (value_seq::vtype);
+	  return std::make_shared <op_capture> (upstream, origin, op, need);
 	}
 
       case tree_type::SUBX_EVAL:
 	{
 	  auto origin = std::make_shared <op_origin> (l);
-	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up);
-	  return std::make_shared <op_subx> (l, upstream, origin, op,
-					     t.cst ().value ().uval ());
+	  size_t keep = t.cst ().value ().uval ();
+	  stack_profile sub_sp;
+	  size_t need;
+	  auto op = build_subexpr (t.child (0), l, rdv_ll, origin, bn, up,
+				   sp, sub_sp, stats, keep, need);
+
+	  // The top values that the subexpression leaves are pushed on
+	  // the original stack.
+	  for (size_t i = keep; i > 0; --i)
+	    sp.push (sub_sp.at (i - 1));
+
+	  return std::make_shared <op_subx> (l, upstream, origin, op, keep,
+					     need);
 	}
 
       case tree_type::CLOSE_STAR:
 	{
 	  auto origin = std::make_shared <op_origin> (l);
-	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up);
+	  stack_profile sub_sp = closure_body_profile (sp);
+	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up,
+				sub_sp, stats);
+	  check_closure_height (sp, sub_sp, stats);
+	  sp.join (sub_sp);
 	  return std::make_shared <op_tr_closure> (l, upstream, origin, op,
 						   op_tr_closure_kind::star);
 	}
@@ -234,7 +614,13 @@ namespace
       case tree_type::CLOSE_PLUS:
 	{
 	  auto origin = std::make_shared <op_origin> (l);
-	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up);
+	  stack_profile sub_sp = closure_body_profile (sp);
+	  auto op = build_exec (t.child (0), l, rdv_ll, origin, bn, up,
+				sub_sp, stats);
+	  check_closure_height (sp, sub_sp, stats);
+	  stack_profile entry_sp = sp;
+	  sp = sub_sp;
+	  sp.join_height (entry_sp);
 	  return std::make_shared <op_tr_closure> (l, upstream, origin, op,
 						   op_tr_closure_kind::plus);
 	}
@@ -242,7 +628,8 @@ namespace
       case tree_type::SCOPE:
 	{
 	  bindings scope {bn};
-	  return build_exec (t.child (0), l, rdv_ll, upstream, scope, up);
+	  return build_exec (t.child (0), l, rdv_ll, upstream, scope, up,
+			     sp, stats);
 	}
 
       case tree_type::BLOCK:
@@ -252,8 +639,9 @@ namespace
 	  layout inner_l;
 	  layout::loc inner_rdv_ll = op_apply::reserve_rendezvous (inner_l);
 	  auto origin = std::make_shared <op_origin> (inner_l);
+	  stack_profile inner_sp;
 	  auto op = build_exec (t.child (0), inner_l, inner_rdv_ll, origin,
-				inner_bn, inner_up);
+				inner_bn, inner_up, inner_sp, stats);
 
 	  std::map <unsigned, std::string> refd_ids = inner_up.refd_ids ();
 	  // Walk the refd names in backward order of their ID, so that
@@ -276,6 +664,7 @@ namespace
 							 rdv_ll);
 	      }
 
+	  sp.push (value_closure::vtype);
 	  return std::make_shared <op_lex_closure> (upstream, inner_l,
 						    inner_rdv_ll, origin, op,
 						    refd_ids.size ());
@@ -285,6 +674,7 @@ namespace
 	{
 	  auto ret = std::make_shared <op_bind> (l, upstream);
 	  bn.bind (t.str (), *ret);
+	  sp.pop (1);
 	  return ret;
 	}
 
@@ -293,8 +683,11 @@ namespace
 	  if (const binding *b = bn.find (t.str ()))
 	    {
 	      if (b->is_builtin ())
-		return build_builtin (b->get_builtin (), upstream, l);
+		return build_builtin (b->get_builtin (), upstream, l,
+				      sp, stats);
 
+	      // The value may be a closure, which can do anything.
+	      sp.clear ();
 	      auto op = std::make_shared <op_read> (upstream, b->get_bind ());
 	      return std::make_shared <op_apply> (l, op, true);
 	    }
@@ -302,8 +695,10 @@ namespace
 	  if (upref *upr = up.find (t.str ()))
 	    {
 	      if (upr->is_builtin ())
-		return build_builtin (upr->get_builtin (), upstream, l);
+		return build_builtin (upr->get_builtin (), upstream, l,
+				      sp, stats);
 
+	      sp.clear ();
 	      auto op = std::make_shared <op_upread> (upstream, upr->get_id (),
 						      rdv_ll);
 	      return std::make_shared <op_apply> (l, op, true);
@@ -315,24 +710,31 @@ namespace
 	}
 
       case tree_type::F_DEBUG:
+	sp.require_all ();
 	return std::make_shared <op_f_debug> (upstream);
 
       case tree_type::IFELSE:
 	{
 	  auto cond_subl = l;
 	  auto cond_origin = std::make_shared <op_origin> (cond_subl);
+	  stack_profile cond_sp = sp;
 	  auto cond_op = build_exec (t.child (0), cond_subl, rdv_ll,
-				     cond_origin, bn, up);
+				     cond_origin, bn, up, cond_sp, stats);
 
 	  auto then_subl = l;
 	  auto then_origin = std::make_shared <op_origin> (then_subl);
+	  stack_profile then_sp = sp;
 	  auto then_op = build_exec (t.child (1), then_subl, rdv_ll,
-				     then_origin, bn, up);
+				     then_origin, bn, up, then_sp, stats);
 
 	  auto else_subl = l;
 	  auto else_origin = std::make_shared <op_origin> (else_subl);
+	  stack_profile else_sp = sp;
 	  auto else_op = build_exec (t.child (2), else_subl, rdv_ll,
-				     else_origin, bn, up);
+				     else_origin, bn, up, else_sp, stats);
+
+	  sp = then_sp;
+	  sp.join (else_sp);
 
 	  l.add_union ({cond_subl, then_subl, else_subl});
 	  return std::make_shared <op_ifelse> (l, upstream,
@@ -351,15 +753,33 @@ namespace
 
     abort ();
   }
+
+  std::shared_ptr <op>
+  build_exec (tree const &t, layout &l, layout::loc rdv_ll,
+	      std::shared_ptr <op> upstream,
+	      bindings &bn, uprefs &up, stack_profile &sp, build_stats &stats)
+  {
+    // CAT and SCOPE only pass on to the nodes that they hold.
+    if (t.m_tt == tree_type::CAT || t.m_tt == tree_type::SCOPE)
+      return build_node_exec (t, l, rdv_ll, upstream, bn, up, sp, stats);
+
+    return build_planned (l, upstream, stats, [&] ()
+      {
+	return build_node_exec (t, l, rdv_ll, upstream, bn, up, sp, stats);
+      });
+  }
 }
 
 std::shared_ptr <op>
 tree::build_exec (layout &l, std::shared_ptr <op> upstream,
-		  vocabulary const &voc) const
+		  vocabulary const &voc, build_stats *stats) const
 {
   uprefs up;
   bindings root {voc};
   bindings bn {root};
   layout::loc no_ll {0xdeadbeef};
-  return ::build_exec (*this, l, no_ll, upstream, bn, up);
+  build_stats dummy;
+  build_stats &st = stats != nullptr ? *stats : dummy;
+  stack_profile sp {st};
+  return ::build_exec (*this, l, no_ll, upstream, bn, up, sp, st);
 }
@@ -0,0 +1,327 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "builtin-agg.hh"
+
+namespace
+{
+  // Order values first by type, then by value.  Comparison of values
+  // of the same type doesn't fail, so this is a total order.
+  cmp_result
+  compare_values (value const &a, value const &b)
+  {
+    cmp_result ret = compare (a.get_type (), b.get_type ());
+    if (ret != cmp_result::equal)
+      return ret;
+
+    ret = a.cmp (b);
+    assert (ret != cmp_result::fail);
+    return ret;
+  }
+}
+
+void
+agg_count::add (value const &v)
+{
+  ++m_count;
+}
+
+std::unique_ptr <value>
+agg_count::result ()
+{
+  return std::make_unique <value_cst>
+    (constant {m_count, &dec_constant_dom}, 0);
+}
+
+value_type
+agg_count::result_type ()
+{
+  return value_cst::vtype;
+}
+
+std::string
+agg_count::docstring ()
+{
+  return
+R"docstring(
+
+Yield number of elements of sequence on TOS.
+
+E.g. the following tests whether the DIE's whose all attributes report
+the same form as their abbreviations suggest, comprise all DIE's.
+This test comes from dwgrep's test suite::
+
+	[entry ([abbrev attribute label] == [attribute label])] length
+	== [entry] length
+
+(Note that this isn't anything that should be universally true, though
+it typically will, and it is for the particular file that this test is
+run on.  Attributes for which their abbreviation suggests
+``DW_FORM_indirect`` will themselves have a different form.)
+
+When ``length`` directly follows a capture, as above, the elements
+are only counted, and the sequence itself is never built.
+
+)docstring";
+}
+
+
+void
+agg_sum::add (value const &v)
+{
+  if (m_failed)
+    return;
+
+  auto cst = value::as <value_cst> (&v);
+  if (cst == nullptr)
+    {
+      std::cerr << "Error: `sum' expects T_CONST elements, got `"
+		<< v << "'.\n";
+      m_failed = true;
+    }
+  else if (m_sum == nullptr)
+    m_sum = std::make_unique <value_cst> (*cst);
+  else if (auto sum = add_csts (*m_sum, *cst))
+    m_sum = std::move (sum);
+  else
+    m_failed = true;
+}
+
+std::unique_ptr <value>
+agg_sum::result ()
+{
+  if (m_failed)
+    return nullptr;
+  if (m_sum == nullptr)
+    return std::make_unique <value_cst>
+      (constant {0, &dec_constant_dom}, 0);
+
+  m_sum->set_pos (0);
+  return std::move (m_sum);
+}
+
+value_type
+agg_sum::result_type ()
+{
+  return value_cst::vtype;
+}
+
+std::string
+agg_sum::docstring ()
+{
+  return
+R"docstring(
+
+Yield sum of elements of sequence on TOS, which all have to be
+constants.  The elements are added the same way that ``add`` adds
+them, so e.g. a sum of constants in hexadecimal domain is shown as
+hexadecimal.  Sum of an empty sequence is 0::
+
+	$ dwgrep '[1, 2, 3] sum'
+	6
+
+If any of the elements is not a constant, or if the sum overflows,
+an error is shown and nothing is yielded.
+
+)docstring";
+}
+
+
+void
+agg_extreme::keep (value const &v, cmp_result want)
+{
+  if (m_best == nullptr || compare_values (v, *m_best) == want)
+    m_best = v.clone ();
+}
+
+std::unique_ptr <value>
+agg_extreme::result ()
+{
+  if (m_best != nullptr)
+    m_best->set_pos (0);
+  return std::move (m_best);
+}
+
+std::string
+agg_min::docstring ()
+{
+  return
+R"docstring(
+
+Yield the least element of sequence on TOS.  Elements are ordered by
+type first, and elements of the same type by value.  If the sequence
+is empty, nothing is yielded::
+
+	$ dwgrep '[3, 1, 2] min'
+	1
+
+)docstring";
+}
+
+std::string
+agg_max::docstring ()
+{
+  return
+R"docstring(
+
+Yield the greatest element of sequence on TOS.  Elements are ordered
+by type first, and elements of the same type by value.  If the
+sequence is empty, nothing is yielded::
+
+	$ dwgrep '[3, 1, 2] max'
+	3
+
+)docstring";
+}
+
+
+void
+value_counts::add (value const &v)
+{
+  size_t hash = v.hash ();
+  auto range = m_index.equal_range (hash);
+  for (auto it = range.first; it != range.second; ++it)
+    {
+      auto &entry = m_values[it->second];
+      if (compare_values (*entry.first, v) == cmp_result::equal)
+	{
+	  ++entry.second;
+	  return;
+	}
+    }
+
+  m_index.emplace (hash, m_values.size ());
+  m_values.emplace_back (v.clone (), 1);
+}
+
+
+void
+agg_distinct::add (value const &v)
+{
+  m_counts.add (v);
+}
+
+std::unique_ptr <value>
+agg_distinct::result ()
+{
+  value_seq::seq_t ret;
+  for (auto &entry: m_counts.values ())
+    {
+      entry.first->set_pos (ret.size ());
+      ret.push_back (std::move (entry.first));
+    }
+
+  return std::make_unique <value_seq> (std::move (ret), 0);
+}
+
+value_type
+agg_distinct::result_type ()
+{
+  return value_seq::vtype;
+}
+
+std::string
+agg_distinct::docstring ()
+{
+  return
+R"docstring(
+
+Yield a sequence of elements of sequence on TOS, with duplicates
+removed.  Elements are kept in order of their first appearance::
+
+	$ dwgrep '[1, 2, 1, 3, 2] distinct'
+	[1, 2, 3]
+
+)docstring";
+}
+
+
+void
+agg_histogram::add (value const &v)
+{
+  m_counts.add (v);
+}
+
+std::unique_ptr <value>
+agg_histogram::result ()
+{
+  auto &values = m_counts.values ();
+  std::sort (values.begin (), values.end (),
+	     [] (std::pair <std::unique_ptr <value>, size_t> const &a,
+		 std::pair <std::unique_ptr <value>, size_t> const &b)
+	     {
+	       return compare_values (*a.first, *b.first) == cmp_result::less;
+	     });
+
+  value_seq::seq_t ret;
+  for (auto &entry: values)
+    {
+      value_seq::seq_t pair;
+      entry.first->set_pos (0);
+      pair.push_back (std::move (entry.first));
+      pair.push_back (std::make_unique <value_cst>
+		      (constant {entry.second, &dec_constant_dom}, 1));
+      ret.push_back (std::make_unique <value_seq> (std::move (pair),
+						   ret.size ()));
+    }
+
+  return std::make_unique <value_seq> (std::move (ret), 0);
+}
+
+value_type
+agg_histogram::result_type ()
+{
+  return value_seq::vtype;
+}
+
+std::string
+agg_histogram::docstring ()
+{
+  return
+R"docstring(
+
+Yield a frequency table of elements of sequence on TOS.  The table is
+a sequence of two-element sequences ``[VALUE, COUNT]``, one for each
+distinct element, ordered the same way that ``min`` and ``max`` order
+elements::
+
+	$ dwgrep '[1, 2, 1, 3, 1] histogram'
+	[[1, 3], [2, 1], [3, 1]]
+
+When ``histogram`` directly follows a capture, elements are counted
+as they are produced, and only one of each distinct value is kept.
+E.g. this tallies tags of all DIE's in a file::
+
+	[entry label] histogram
+
+)docstring";
+}
@@ -0,0 +1,334 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _BUILTIN_AGG_H_
+#define _BUILTIN_AGG_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "builtin.hh"
+#include "op.hh"
+#include "overload.hh"
+#include "value-cst.hh"
+#include "value-seq.hh"
+
+// Aggregating words reduce a sequence to a single value, e.g. its
+// length or the sum of its elements.  Each such word is an overload
+// for T_SEQ whose work is done by an aggregator.  An aggregator is a
+// class with the following interface:
+//
+//   void add (value const &v);		-- take V into account
+//   std::unique_ptr <value> result ();	-- return the result, or
+//					   nullptr if there's none
+//   static char const *name ();
+//   static std::string docstring ();
+//   static yield yields ();		-- yield::once or yield::maybe
+//   static value_type result_type ();
+//
+// Aggregators only keep as much as they need for the result.  When
+// the word directly follows a capture, as in [A] length, the builder
+// feeds values that A produces straight to the aggregator, and the
+// sequence is never built.
+
+template <class Agg>
+class op_aggregate_seq
+  : public inner_op
+{
+public:
+  using inner_op::inner_op;
+
+  stack::uptr
+  next (scon &sc) const override
+  {
+    while (auto stk = m_upstream->next (sc))
+      {
+	Agg agg;
+	auto seq = stk->pop_as <value_seq> ();
+	for (auto const &v: *seq->get_seq ())
+	  agg.add (*v);
+
+	if (auto v = agg.result ())
+	  {
+	    stk->push (std::move (v));
+	    return stk;
+	  }
+      }
+
+    return nullptr;
+  }
+
+  std::string
+  name () const override
+  {
+    return Agg::name ();
+  }
+};
+
+// Like op_capture, but instead of collecting values that OP yields
+// into a sequence, feed them to an aggregator.
+template <class Agg>
+class op_capture_aggregate
+  : public inner_op
+{
+  std::shared_ptr <op_origin> m_origin;
+  std::shared_ptr <op> m_op;
+  size_t m_need;
+
+public:
+  op_capture_aggregate (std::shared_ptr <op> upstream,
+			std::shared_ptr <op_origin> origin,
+			std::shared_ptr <op> op,
+			size_t need)
+    : inner_op {upstream}
+    , m_origin {origin}
+    , m_op {op}
+    , m_need {need}
+  {}
+
+  void
+  state_con (scon &sc) const override
+  {
+    m_op->state_con (sc);
+    inner_op::state_con (sc);
+  }
+
+  void
+  state_des (scon &sc) const override
+  {
+    inner_op::state_des (sc);
+    m_op->state_des (sc);
+  }
+
+  void
+  state_reset (scon &sc) const override
+  {
+    m_op->state_reset (sc);
+    inner_op::state_reset (sc);
+  }
+
+  stack::uptr
+  next (scon &sc) const override
+  {
+    while (auto stk = m_upstream->next (sc))
+      {
+	m_origin->set_next (sc, *stk, m_need);
+
+	Agg agg;
+	while (auto stk2 = m_op->next (sc))
+	  agg.add (*stk2->pop ());
+	m_op->state_reset (sc);
+
+	if (auto v = agg.result ())
+	  {
+	    stk->push (std::move (v));
+	    return stk;
+	  }
+      }
+
+    return nullptr;
+  }
+
+  std::string
+  name () const override
+  {
+    return std::string (Agg::name ()) + "<" + m_op->name () + ">";
+  }
+};
+
+// An overload for T_SEQ that aggregates elements of the sequence.
+// Unlike other overloads, it can also build the fused op that a
+// capture followed by the word turns into.
+struct aggregate_overload
+  : public builtin
+{
+  virtual std::shared_ptr <op>
+  build_capture (std::shared_ptr <op> upstream,
+		 std::shared_ptr <op_origin> origin,
+		 std::shared_ptr <op> op, size_t need) const = 0;
+};
+
+template <class Agg>
+struct aggregate_overload_builtin
+  : public aggregate_overload
+{
+  std::shared_ptr <op>
+  build_exec (layout &l, std::shared_ptr <op> upstream) const override
+  {
+    return std::make_shared <op_aggregate_seq <Agg>> (upstream);
+  }
+
+  std::shared_ptr <op>
+  build_capture (std::shared_ptr <op> upstream,
+		 std::shared_ptr <op_origin> origin,
+		 std::shared_ptr <op> op, size_t need) const override
+  {
+    return std::make_shared <op_capture_aggregate <Agg>>
+      (upstream, origin, op, need);
+  }
+
+  char const *
+  name () const override
+  {
+    return "overload";
+  }
+
+  std::string
+  docstring () const override
+  {
+    return Agg::docstring ();
+  }
+
+  builtin_protomap
+  protomap () const override
+  {
+    return {
+      builtin_prototype ({value_seq::vtype}, Agg::yields (),
+			 {Agg::result_type ()}),
+    };
+  }
+};
+
+template <class Agg>
+void
+add_aggregate_overload (overload_tab &tab)
+{
+  tab.add_overload (selector {value_seq::vtype},
+		    std::make_shared <aggregate_overload_builtin <Agg>> ());
+}
+
+
+class agg_count
+{
+  size_t m_count = 0;
+
+public:
+  void add (value const &v);
+  std::unique_ptr <value> result ();
+
+  static char const *name () { return "count"; }
+  static std::string docstring ();
+  static yield yields () { return yield::once; }
+  static value_type result_type ();
+};
+
+class agg_sum
+{
+  std::unique_ptr <value_cst> m_sum;
+  bool m_failed = false;
+
+public:
+  void add (value const &v);
+  std::unique_ptr <value> result ();
+
+  static char const *name () { return "sum"; }
+  static std::string docstring ();
+  static yield yields () { return yield::maybe; }
+  static value_type result_type ();
+};
+
+class agg_extreme
+{
+  std::unique_ptr <value> m_best;
+
+protected:
+  // Keep V if it compares WANT to the best value seen so far.
+  void keep (value const &v, cmp_result want);
+
+public:
+  std::unique_ptr <value> result ();
+
+  static yield yields () { return yield::maybe; }
+  static value_type result_type () { return value::vtype; }
+};
+
+class agg_min
+  : public agg_extreme
+{
+public:
+  void add (value const &v) { keep (v, cmp_result::less); }
+
+  static char const *name () { return "min"; }
+  static std::string docstring ();
+};
+
+class agg_max
+  : public agg_extreme
+{
+public:
+  void add (value const &v) { keep (v, cmp_result::greater); }
+
+  static char const *name () { return "max"; }
+  static std::string docstring ();
+};
+
+// Distinct values seen so far, each with a number of times that it
+// was seen.  Values are looked up by hash, and compared only when
+// hashes match.
+class value_counts
+{
+  std::vector <std::pair <std::unique_ptr <value>, size_t>> m_values;
+  std::unordered_multimap <size_t, size_t> m_index;
+
+public:
+  void add (value const &v);
+
+  std::vector <std::pair <std::unique_ptr <value>, size_t>> &
+  values ()
+  { return m_values; }
+};
+
+class agg_distinct
+{
+  value_counts m_counts;
+
+public:
+  void add (value const &v);
+  std::unique_ptr <value> result ();
+
+  static char const *name () { return "distinct"; }
+  static std::string docstring ();
+  static yield yields () { return yield::once; }
+  static value_type result_type ();
+};
+
+class agg_histogram
+{
+  value_counts m_counts;
+
+public:
+  void add (value const &v);
+  std::unique_ptr <value> result ();
+
+  static char const *name () { return "histogram"; }
+  static std::string docstring ();
+  static yield yields () { return yield::once; }
+  static value_type result_type ();
+};
+
+#endif /* _BUILTIN_AGG_H_ */
@@ -34,20 +34,29 @@
 #include "value-closure.hh"
 #include "scon.hh"
 
-// State for the sub-program that the apply executes. This gets constructed each
-// time a new program is pulled from upstream, then used to fetch stacks to
-// yield, and then torn down.
-struct op_apply::substate
+// State for this operation.  The closure being applied runs in its
+// own scon, which is kept across applications, so that its buffer
+// can be reused.  It is constructed each time a new closure is pulled
+// from upstream, then used to fetch stacks to yield, and then torn
+// down.
+struct op_apply::state
 {
+  // The closure being applied, or nullptr if none is.
   std::unique_ptr <value_closure> m_value;
   scon m_scon;
-  scon_guard m_sg;
 
-  substate (stack::uptr stk)
-    : m_value {static_cast <value_closure *> (stk->pop ().release ())}
-    , m_scon {m_value->get_layout ()}
-    , m_sg {m_scon, m_value->get_op ()}
+  ~state ()
+  {
+    if (m_value != nullptr)
+      finish ();
+  }
+
+  void
+  start (stack::uptr stk)
   {
+    m_value.reset (static_cast <value_closure *> (stk->pop ().release ()));
+    m_scon.renew (m_value->get_layout ());
+    m_value->get_op ().state_con (m_scon);
     m_scon.con <op_apply::rendezvous> (m_value->get_rdv_ll (),
 				       std::ref (*m_value));
     m_value->get_origin ().set_next (m_scon, std::move (stk));
@@ -58,12 +67,13 @@ struct op_apply::substate
   {
     return m_value->get_op ().next (m_scon);
   }
-};
 
-// State for this operation.
-struct op_apply::state
-{
-  std::unique_ptr <substate> m_substate;
+  void
+  finish ()
+  {
+    m_value->get_op ().state_des (m_scon);
+    m_value = nullptr;
+  }
 };
 
 op_apply::op_apply (layout &l, std::shared_ptr <op> upstream,
@@ -93,13 +103,22 @@ op_apply::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_apply::state_reset (scon &sc) const
+{
+  state &st = sc.get <state> (m_ll);
+  if (st.m_value != nullptr)
+    st.finish ();
+  m_upstream->state_reset (sc);
+}
+
 stack::uptr
 op_apply::next (scon &sc) const
 {
   state &st = sc.get <state> (m_ll);
   while (true)
     {
-      while (st.m_substate == nullptr)
+      while (st.m_value == nullptr)
 	if (auto stk = m_upstream->next (sc))
 	  {
 	    if (! stk->top ().is <value_closure> ())
@@ -111,15 +130,15 @@ op_apply::next (scon &sc) const
 		continue;
 	      }
 
-	    st.m_substate = std::make_unique <substate> (std::move (stk));
+	    st.start (std::move (stk));
 	  }
 	else
 	  return nullptr;
 
-      if (auto stk = st.m_substate->next ())
+      if (auto stk = st.next ())
 	return stk;
 
-      st.m_substate = nullptr;
+      st.finish ();
     }
 }
 
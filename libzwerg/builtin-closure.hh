@@ -40,7 +40,6 @@ class op_apply
   : public op
 {
   struct state;
-  struct substate;
   std::shared_ptr <op> m_upstream;
   bool m_skip_non_closures;
   layout::loc m_ll;
@@ -53,6 +52,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 
   // Rendezvous state. Rendezvous is an area at the beginning of substate where
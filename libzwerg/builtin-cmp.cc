@@ -33,6 +33,7 @@
 #include "builtin-cmp.hh"
 #include "op.hh"
 #include "pred_result.hh"
+#include "stack_profile.hh"
 #include "value-cst.hh"
 
 namespace
@@ -161,6 +162,12 @@ builtin_eq::docstring () const
   return cmp_docstring;
 }
 
+void
+builtin_eq::stack_effect (stack_profile &sp) const
+{
+  sp.require (2);
+}
+
 
 std::unique_ptr <pred>
 builtin_lt::build_pred (layout &l) const
@@ -183,6 +190,12 @@ builtin_lt::docstring () const
   return cmp_docstring;
 }
 
+void
+builtin_lt::stack_effect (stack_profile &sp) const
+{
+  sp.require (2);
+}
+
 
 std::unique_ptr <pred>
 builtin_gt::build_pred (layout &l) const
@@ -204,3 +217,9 @@ builtin_gt::docstring () const
 {
   return cmp_docstring;
 }
+
+void
+builtin_gt::stack_effect (stack_profile &sp) const
+{
+  sp.require (2);
+}
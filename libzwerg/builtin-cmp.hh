@@ -41,6 +41,7 @@ struct builtin_eq
 
   char const *name () const override;
   std::string docstring () const override;
+  void stack_effect (stack_profile &sp) const override;
 };
 
 struct builtin_lt
@@ -52,6 +53,7 @@ struct builtin_lt
 
   char const *name () const override;
   std::string docstring () const override;
+  void stack_effect (stack_profile &sp) const override;
 };
 
 struct builtin_gt
@@ -63,6 +65,7 @@ struct builtin_gt
 
   char const *name () const override;
   std::string docstring () const override;
+  void stack_effect (stack_profile &sp) const override;
 };
 
 #endif /* _BUILTIN_CMP_H_ */
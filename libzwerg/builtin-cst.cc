@@ -33,6 +33,7 @@
 
 #include "builtin-cst.hh"
 #include "op.hh"
+#include "stack_profile.hh"
 #include "value-cst.hh"
 
 namespace
@@ -229,6 +230,12 @@ builtin_pred_pos::docstring () const
   return "";
 }
 
+void
+builtin_pred_pos::stack_effect (stack_profile &sp) const
+{
+  sp.require (1);
+}
+
 
 stack::uptr
 op_type::next (scon &sc) const
@@ -109,6 +109,7 @@ public:
 
   char const *name () const override;
   std::string docstring () const override;
+  void stack_effect (stack_profile &sp) const override;
 };
 
 struct op_type
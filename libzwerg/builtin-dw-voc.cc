@@ -75,13 +75,19 @@ dwgrep_vocabulary_dw ()
   }
 
   {
-    auto t = std::make_shared <overload_tab> ();
+    auto make_tab = [] (die_filter const &filter)
+      {
+	auto t = std::make_shared <overload_tab> ();
 
-    t->add_op_overload <op_entry_dwarf> ();
-    t->add_op_overload <op_entry_cu> ();
-    t->add_op_overload <op_entry_abbrev_unit> ();
+	t->add_op_overload <op_entry_dwarf> (filter);
+	t->add_op_overload <op_entry_cu> (filter);
+	t->add_op_overload <op_entry_abbrev_unit> ();
 
-    voc.add (std::make_shared <overloaded_op_builtin> ("entry", t));
+	return t;
+      };
+
+    voc.add (std::make_shared <overloaded_die_producer_builtin>
+		("entry", make_tab));
   }
 
   {
@@ -112,11 +118,17 @@ dwgrep_vocabulary_dw ()
   }
 
   {
-    auto t = std::make_shared <overload_tab> ();
+    auto make_tab = [] (die_filter const &filter)
+      {
+	auto t = std::make_shared <overload_tab> ();
+
+	t->add_op_overload <op_child_die> (filter);
 
-    t->add_op_overload <op_child_die> ();
+	return t;
+      };
 
-    voc.add (std::make_shared <overloaded_op_builtin> ("child", t));
+    voc.add (std::make_shared <overloaded_die_producer_builtin>
+		("child", make_tab));
   }
 
   {
@@ -172,6 +184,22 @@ dwgrep_vocabulary_dw ()
     voc.add (std::make_shared <overloaded_op_builtin> ("address", t));
   }
 
+  {
+    auto t = std::make_shared <overload_tab> ();
+
+    t->add_op_overload <op_lookup_dwarf> ();
+
+    voc.add (std::make_shared <overloaded_op_builtin> ("lookup", t));
+  }
+
+  {
+    auto t = std::make_shared <overload_tab> ();
+
+    t->add_op_overload <op_scope_dwarf> ();
+
+    voc.add (std::make_shared <overloaded_op_builtin> ("scope", t));
+  }
+
   {
     auto t = std::make_shared <overload_tab> ();
 
@@ -421,10 +449,14 @@ dwgrep_vocabulary_dw ()
 	t->add_pred_overload <pred_atname_abbrev_attr> (code);
 	t->add_pred_overload <pred_atname_cst> (code);
 
-	voc.add (std::make_shared <overloaded_pred_builtin> (qname, t, true));
-	voc.add (std::make_shared <overloaded_pred_builtin> (bname, t, false));
-	voc.add (std::make_shared <overloaded_pred_builtin> (lqname, t, true));
-	voc.add (std::make_shared <overloaded_pred_builtin> (lbname, t, false));
+	voc.add (std::make_shared <overloaded_atname_pred_builtin>
+			(qname, t, true, code));
+	voc.add (std::make_shared <overloaded_atname_pred_builtin>
+			(bname, t, false, code));
+	voc.add (std::make_shared <overloaded_atname_pred_builtin>
+			(lqname, t, true, code));
+	voc.add (std::make_shared <overloaded_atname_pred_builtin>
+			(lbname, t, false, code));
       }
 
       // @AT_* etc.
@@ -434,8 +466,10 @@ dwgrep_vocabulary_dw ()
 	t->add_op_overload <op_atval_die> (code);
 	// xxx raw shouldn't interpret values
 
-	voc.add (std::make_shared <overloaded_op_builtin> (atname, t));
-	voc.add (std::make_shared <overloaded_op_builtin> (latname, t));
+	voc.add (std::make_shared <overloaded_atval_builtin>
+			(atname, t, code));
+	voc.add (std::make_shared <overloaded_atval_builtin>
+			(latname, t, code));
       }
 
       // DW_AT_*
@@ -458,10 +492,14 @@ dwgrep_vocabulary_dw ()
       t->add_pred_overload <pred_tag_abbrev> (code);
       t->add_pred_overload <pred_tag_cst> (code);
 
-      voc.add (std::make_shared <overloaded_pred_builtin> (qname, t, true));
-      voc.add (std::make_shared <overloaded_pred_builtin> (bname, t, false));
-      voc.add (std::make_shared <overloaded_pred_builtin> (lqname, t, true));
-      voc.add (std::make_shared <overloaded_pred_builtin> (lbname, t, false));
+      voc.add (std::make_shared <overloaded_tag_pred_builtin>
+			(qname, t, true, code));
+      voc.add (std::make_shared <overloaded_tag_pred_builtin>
+			(bname, t, false, code));
+      voc.add (std::make_shared <overloaded_tag_pred_builtin>
+			(lqname, t, true, code));
+      voc.add (std::make_shared <overloaded_tag_pred_builtin>
+			(lbname, t, false, code));
 
       add_builtin_constant (voc, constant (code, &dw_tag_dom ()), lqname + 1);
     };
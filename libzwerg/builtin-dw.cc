@@ -30,12 +30,14 @@
 #include <memory>
 #include <sstream>
 
+#include "addr_index.hh"
 #include "atval.hh"
 #include "builtin-dw.hh"
 #include "dwcst.hh"
 #include "dwit.hh"
 #include "dwmods.hh"
 #include "dwpp.hh"
+#include "name_index.hh"
 #include "op.hh"
 #include "overload.hh"
 #include "value-cst.hh"
@@ -116,13 +118,69 @@ namespace
       return std::make_unique <value_cu> (m_dwctx, cu, off, m_i++, m_doneness);
     }
   };
+
+  // Like dwarf_unit_producer, but only yields units taken from a
+  // pool, which is possibly shared with producers on other threads.
+  struct pooled_unit_producer
+    : public value_producer <value_cu>
+  {
+    std::shared_ptr <dwfl_context> m_dwctx;
+    std::shared_ptr <cu_pool> m_pool;
+    std::vector <Dwarf *> m_dwarfs;
+    size_t m_i;
+    doneness m_doneness;
+
+    pooled_unit_producer (std::shared_ptr <dwfl_context> dwctx,
+			  std::shared_ptr <cu_pool> pool, doneness d)
+      : m_dwctx {dwctx}
+      , m_pool {pool}
+      , m_dwarfs {all_dwarfs (*dwctx)}
+      , m_i {0}
+      , m_doneness {d}
+    {}
+
+    std::unique_ptr <value_cu>
+    next () override
+    {
+      cu_pool::cu_ref ref;
+      while (m_pool->take (ref))
+	{
+	  assert (ref.dwarf_idx < m_dwarfs.size ());
+	  Dwarf_Die cudie;
+	  if (dwarf_offdie (m_dwarfs[ref.dwarf_idx], ref.die_offset,
+			    &cudie) == nullptr)
+	    throw_libdw ();
+
+	  // In cooked mode, we reject partial units.
+	  if (m_doneness == doneness::cooked
+	      && dwarf_tag (&cudie) == DW_TAG_partial_unit)
+	    continue;
+
+	  return std::make_unique <value_cu> (m_dwctx, *cudie.cu,
+					      ref.cu_offset, m_i++,
+					      m_doneness);
+	}
+
+      return nullptr;
+    }
+  };
+
+  std::unique_ptr <value_producer <value_cu>>
+  make_unit_producer (value_dwarf const &dw)
+  {
+    if (auto pool = dw.get_cu_pool ())
+      return std::make_unique <pooled_unit_producer>
+	(dw.get_dwctx (), pool, dw.get_doneness ());
+    else
+      return std::make_unique <dwarf_unit_producer>
+	(dw.get_dwctx (), dw.get_doneness ());
+  }
 }
 
 std::unique_ptr <value_producer <value_cu>>
 op_unit_dwarf::operate (std::unique_ptr <value_dwarf> a) const
 {
-  return std::make_unique <dwarf_unit_producer> (a->get_dwctx (),
-						 a->get_doneness ());
+  return make_unit_producer (*a);
 }
 
 std::string
@@ -317,14 +375,19 @@ namespace
     // Chain of DIE's where partial units were imported.
     std::shared_ptr <value_die> m_import;
 
+    // Number of DIE's visited so far, including those that were
+    // skipped by the filter, so that positions stay the same as
+    // without it.
     size_t m_i;
     doneness m_doneness;
+    die_filter const &m_filter;
 
     die_it_producer (std::shared_ptr <dwfl_context> dwctx, Dwarf_Die die,
-		     doneness d)
+		     doneness d, die_filter const &filter)
       : m_dwctx {dwctx}
       , m_i {0}
       , m_doneness {d}
+      , m_filter {filter}
     {
       m_stack.push_back (get_it_range <It> (die, false));
     }
@@ -332,24 +395,30 @@ namespace
     std::unique_ptr <value_die>
     next () override
     {
-      do
-	if (m_stack.empty ())
-	  return nullptr;
-      while (drop_finished_imports (m_stack, m_import)
-	     || (m_doneness == doneness::cooked
-		 && import_partial_units (m_stack, m_dwctx, m_import)));
-
-      return std::make_unique <value_die>
-	(m_dwctx, m_import, **m_stack.back ().first++, m_i++, m_doneness);
+      while (true)
+	{
+	  do
+	    if (m_stack.empty ())
+	      return nullptr;
+	  while (drop_finished_imports (m_stack, m_import)
+		 || (m_doneness == doneness::cooked
+		     && import_partial_units (m_stack, m_dwctx, m_import)));
+
+	  Dwarf_Die die = **m_stack.back ().first++;
+	  size_t i = m_i++;
+	  if (m_filter.may_pass (die, m_doneness))
+	    return std::make_unique <value_die>
+	      (m_dwctx, m_import, die, i, m_doneness);
+	}
     }
   };
 
   std::unique_ptr <value_producer <value_die>>
   make_cu_entry_producer (std::shared_ptr <dwfl_context> dwctx, Dwarf_CU &cu,
-			  doneness d)
+			  doneness d, die_filter const &filter)
   {
     return std::make_unique <die_it_producer <all_dies_iterator>>
-      (dwctx, dwpp_cudie (cu), d);
+      (dwctx, dwpp_cudie (cu), d, filter);
   }
 }
 
@@ -358,7 +427,7 @@ std::unique_ptr <value_producer <value_die>>
 op_entry_cu::operate (std::unique_ptr <value_cu> a) const
 {
   return make_cu_entry_producer (a->get_dwctx (), a->get_cu (),
-				 a->get_doneness ());
+				 a->get_doneness (), m_filter);
 }
 
 std::string
@@ -404,12 +473,20 @@ namespace
   struct dwarf_entry_producer
     : public value_producer <value_die>
   {
-    dwarf_unit_producer m_unitprod;
+    std::shared_ptr <dwfl_context> m_dwctx;
+    std::unique_ptr <value_producer <value_cu>> m_unitprod;
     std::unique_ptr <die_it_producer <all_dies_iterator>> m_dieprod;
+    doneness m_doneness;
+    die_filter const &m_filter;
+
+    // Number of DIE's visited in units that are done.
     size_t m_i;
 
-    dwarf_entry_producer (std::shared_ptr <dwfl_context> dwctx, doneness d)
-      : m_unitprod {dwctx, d}
+    dwarf_entry_producer (value_dwarf const &dw, die_filter const &filter)
+      : m_dwctx {dw.get_dwctx ()}
+      , m_unitprod {make_unit_producer (dw)}
+      , m_doneness {dw.get_doneness ()}
+      , m_filter {filter}
       , m_i {0}
     {}
 
@@ -419,30 +496,87 @@ namespace
       while (true)
 	{
 	  while (m_dieprod == nullptr)
-	    if (auto cu = m_unitprod.next ())
+	    if (auto cu = m_unitprod->next ())
 	      m_dieprod = std::make_unique <die_it_producer <all_dies_iterator>>
-				(m_unitprod.m_dwctx, dwpp_cudie (cu->get_cu ()),
-				 m_unitprod.m_doneness);
+				(m_dwctx, dwpp_cudie (cu->get_cu ()),
+				 m_doneness, m_filter);
 	    else
 	      return nullptr;
 
 	  if (auto ret = m_dieprod->next ())
 	    {
-	      ret->set_pos (m_i++);
+	      ret->set_pos (m_i + ret->get_pos ());
 	      return ret;
 	    }
 
+	  m_i += m_dieprod->m_i;
 	  m_dieprod = nullptr;
 	}
     }
   };
+
+  // Yields DIE's listed in the name index, in the same order and at
+  // the same positions as dwarf_entry_producer would.
+  struct named_entry_producer
+    : public value_producer <value_die>
+  {
+    std::shared_ptr <dwfl_context> m_dwctx;
+    std::vector <name_index::entry> const *m_entries;
+    size_t m_i;
+    doneness m_doneness;
+    die_filter const &m_filter;
+
+    named_entry_producer (std::shared_ptr <dwfl_context> dwctx,
+			  std::vector <name_index::entry> const *entries,
+			  doneness d, die_filter const &filter)
+      : m_dwctx {dwctx}
+      , m_entries {entries}
+      , m_i {0}
+      , m_doneness {d}
+      , m_filter {filter}
+    {}
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      while (m_entries != nullptr && m_i < m_entries->size ())
+	{
+	  auto const &entry = (*m_entries)[m_i++];
+	  Dwarf_Die die;
+	  if (dwarf_offdie (entry.dw, entry.offset, &die) == nullptr)
+	    throw_libdw ();
+	  if (m_filter.may_pass (die, m_doneness))
+	    return std::make_unique <value_die> (m_dwctx, die, entry.pos,
+						 m_doneness);
+	}
+      return nullptr;
+    }
+  };
+
+  std::unique_ptr <value_producer <value_die>>
+  make_dwarf_entry_producer (value_dwarf const &dw, die_filter const &filter)
+  {
+    // The name index can't be used when units are split among
+    // threads, and positions that it records don't apply when
+    // partial units get imported.
+    if (std::string const *name = filter.name ())
+      if (dw.get_cu_pool () == nullptr)
+	{
+	  auto dwctx = dw.get_dwctx ();
+	  name_index const &idx = dwctx->get_name_index ();
+	  if (dw.get_doneness () == doneness::raw || ! idx.has_imports ())
+	    return std::make_unique <named_entry_producer>
+	      (dwctx, idx.find (*name), dw.get_doneness (), filter);
+	}
+
+    return std::make_unique <dwarf_entry_producer> (dw, filter);
+  }
 }
 
 std::unique_ptr <value_producer <value_die>>
 op_entry_dwarf::operate (std::unique_ptr <value_dwarf> a) const
 {
-  return std::make_unique <dwarf_entry_producer> (a->get_dwctx (),
-						  a->get_doneness ());
+  return make_dwarf_entry_producer (*a, m_filter);
 }
 
 std::string
@@ -465,10 +599,11 @@ namespace
 {
   std::unique_ptr <value_producer <value_die>>
   make_die_child_producer (std::shared_ptr <dwfl_context> dwctx,
-			   Dwarf_Die parent, doneness d)
+			   Dwarf_Die parent, doneness d,
+			   die_filter const &filter)
   {
     return std::make_unique <die_it_producer <child_iterator>>
-      (dwctx, parent, d);
+      (dwctx, parent, d, filter);
   }
 }
 
@@ -477,7 +612,20 @@ std::unique_ptr <value_producer <value_die>>
 op_child_die::operate (std::unique_ptr <value_die> a) const
 {
   return make_die_child_producer (a->get_dwctx (), a->get_die (),
-				  a->get_doneness ());
+				  a->get_doneness (), m_filter);
+}
+
+bool
+op_child_die::exists (std::unique_ptr <value_die> a) const
+{
+  // Cooked children of imported units may come out empty, and
+  // filters may reject everything, so those need a proper look.  The
+  // DW_CHILDREN flag doesn't do either, because the list of children
+  // may hold nothing but the terminating null entry.
+  Dwarf_Die child;
+  if (a->get_doneness () == doneness::raw && m_filter.empty ())
+    return dwpp_child (a->get_die (), child);
+  return op_yielding_overload::exists (std::move (a));
 }
 
 std::string
@@ -720,6 +868,13 @@ op_attribute_die::operate (std::unique_ptr <value_die> a) const
   return std::make_unique <attribute_producer> (std::move (a));
 }
 
+bool
+op_attribute_die::exists (std::unique_ptr <value_die> a) const
+{
+  // Only attributes at the DIE itself can lead to integrated ones.
+  return attr_iterator {&a->get_die ()} != attr_iterator::end ();
+}
+
 std::string
 op_attribute_die::docstring ()
 {
@@ -920,6 +1075,83 @@ covered by this DIE.  (This calls dwarf_ranges under the covers.)::
 )docstring";
 }
 
+
+// scope
+
+namespace
+{
+  struct scope_producer
+    : public value_producer <value_die>
+  {
+    std::shared_ptr <dwfl_context> m_dwctx;
+    std::vector <Dwarf_Die> m_scopes;
+    doneness m_doneness;
+    size_t m_i;
+
+    scope_producer (std::shared_ptr <dwfl_context> dwctx,
+		    std::vector <Dwarf_Die> scopes, doneness d)
+      : m_dwctx {dwctx}
+      , m_scopes {std::move (scopes)}
+      , m_doneness {d}
+      , m_i {0}
+    {}
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      if (m_i < m_scopes.size ())
+	{
+	  size_t pos = m_i++;
+	  return std::make_unique <value_die> (m_dwctx, m_scopes[pos], pos,
+					       m_doneness);
+	}
+      return nullptr;
+    }
+  };
+}
+
+std::unique_ptr <value_producer <value_die>>
+op_scope_dwarf::operate (std::unique_ptr <value_dwarf> a,
+			 std::unique_ptr <value_cst> b) const
+{
+  auto addr = b->get_constant ().value ();
+  std::vector <Dwarf_Die> scopes;
+  if (addr >= 0)
+    scopes = a->get_dwctx ()->get_addr_index ().find_scopes (addr.uval ());
+  return std::make_unique <scope_producer> (a->get_dwctx (),
+					    std::move (scopes),
+					    a->get_doneness ());
+}
+
+std::string
+op_scope_dwarf::docstring ()
+{
+  return
+R"docstring(
+
+Takes a Dwarf and an address on TOS and yields DIE's whose code covers
+that address: for each subprogram that contains the address, the
+scopes nested in it (inlined subroutines and lexical blocks) from the
+innermost out, then the subprogram itself, and finally the unit DIE::
+
+	$ dwgrep ./tests/bitcount.o -e '0x10 scope "%s"'
+	[9e] lexical_block
+	[70] subprogram
+	[b] compile_unit
+
+Ranges of units and subprograms are indexed the first time that this
+word is used on a given Dwarf, so looking up many addresses is cheap.
+This is about equivalent to the following, which however inspects all
+DIE's for every address::
+
+	(|Dw Addr| Dw entry ?(address Addr ?contains))
+
+Units whose unit DIE doesn't describe the covered addresses are not
+considered.
+
+)docstring";
+}
+
 namespace
 {
   std::unique_ptr <value_cst>
@@ -1773,6 +2005,19 @@ op_atval_die::operate (std::unique_ptr <value_die> a) const
   return at_value (dv->get_dwctx (), *dv, attr);
 }
 
+bool
+op_atval_die::exists (std::unique_ptr <value_die> a) const
+{
+  Dwarf_Attribute attr;
+  auto r = find_attribute (a->get_die (), m_atname, a->get_doneness (),
+			   &attr, a->get_dwctx ());
+  if (r.first == find_attribute_result::not_found)
+    return false;
+  auto dv = r.second != nullptr ? std::move (r.second) : std::move (a);
+
+  return at_value_exists (dv->get_dwctx (), *dv, attr);
+}
+
 std::string
 op_atval_die::docstring ()
 {
@@ -1791,6 +2036,83 @@ value)``::
 }
 
 
+// lookup
+
+namespace
+{
+  struct lookup_producer
+    : public value_producer <value_die>
+  {
+    std::string m_name;
+    die_filter m_filter;
+    std::unique_ptr <value_producer <value_die>> m_prod;
+    size_t m_i;
+
+    lookup_producer (value_dwarf const &dw, std::string const &name)
+      : m_name {name}
+      , m_i {0}
+    {
+      m_filter.add_name (m_name);
+      m_prod = make_dwarf_entry_producer (dw, m_filter);
+    }
+
+    std::unique_ptr <value_die>
+    next () override
+    {
+      while (auto die = m_prod->next ())
+	{
+	  Dwarf_Attribute at;
+	  if (find_attribute (die->get_die (), DW_AT_name,
+			      die->get_doneness (), &at, nullptr).first
+		== find_attribute_result::not_found)
+	    continue;
+
+	  char const *name = dwarf_formstring (&at);
+	  if (name != nullptr && m_name == name)
+	    {
+	      die->set_pos (m_i++);
+	      return die;
+	    }
+	}
+
+      return nullptr;
+    }
+  };
+}
+
+std::unique_ptr <value_producer <value_die>>
+op_lookup_dwarf::operate (std::unique_ptr <value_dwarf> a,
+			  std::unique_ptr <value_str> b) const
+{
+  return std::make_unique <lookup_producer> (*a, b->get_string ());
+}
+
+std::string
+op_lookup_dwarf::docstring ()
+{
+  return
+R"docstring(
+
+Takes a Dwarf and a string on TOS and yields DIE's whose ``@AT_name``
+is that string::
+
+	$ dwgrep ./tests/twocus -e '"foo" lookup "%s"'
+	[2d] subprogram
+	[a3] subprogram
+
+This is the same as ``entry ?(@AT_name == STR)``, except that
+positions of the yielded DIE's are numbered from zero.  Unless units
+are shared among threads, DIE's are looked up in a name index, which
+is built the first time that it's needed for a given Dwarf.
+
+The expression ``entry ?(@AT_name == "literal")``, as well as its
+variant without ``?``, is recognized when building a query and uses
+the same index.
+
+)docstring";
+}
+
+
 // ?AT_*
 
 pred_atname_die::pred_atname_die (unsigned atname)
@@ -1957,6 +2279,128 @@ indicated by this word::
 }
 
 
+// Fusion of DIE producers with the predicates that follow them.
+
+void
+die_filter::add_tag (int tag, bool positive)
+{
+  m_tags.push_back (std::make_pair (tag, positive));
+}
+
+void
+die_filter::add_atname (unsigned atname, bool positive)
+{
+  m_atnames.push_back (std::make_pair (atname, positive));
+}
+
+void
+die_filter::add_name (std::string const &name)
+{
+  m_names.push_back (name);
+  add_atname (DW_AT_name, true);
+}
+
+namespace
+{
+  bool
+  abbrev_has_attr (Dwarf_Abbrev *abbrev, unsigned atname)
+  {
+    unsigned name;
+    for (size_t i = 0;
+	 dwarf_getabbrevattr (abbrev, i, &name, nullptr, nullptr) == 0; ++i)
+      if (name == atname)
+	return true;
+    return false;
+  }
+}
+
+bool
+die_filter::may_pass (Dwarf_Die &die, doneness d) const
+{
+  if (m_tags.empty () && m_atnames.empty ())
+    return true;
+
+  // If the DIE doesn't have an abbreviation yet, force its look-up.
+  // If that fails, let the predicates themselves deal with the DIE.
+  if (die.abbrev == nullptr)
+    dwarf_haschildren (&die);
+  Dwarf_Abbrev *abbrev = die.abbrev;
+  if (abbrev == nullptr || abbrev == (Dwarf_Abbrev *) -1l)
+    return true;
+
+  if (! m_tags.empty ())
+    {
+      int tag = dwarf_getabbrevtag (abbrev);
+      for (auto const &cond: m_tags)
+	if ((tag == cond.first) != cond.second)
+	  return false;
+    }
+
+  for (auto const &cond: m_atnames)
+    {
+      bool has = abbrev_has_attr (abbrev, cond.first);
+
+      // Cooked DIE's may integrate the attribute from the DIE that
+      // they refer to.  The abbreviation alone can't tell.
+      if (! has && d == doneness::cooked
+	  && attr_should_be_integrated (cond.first)
+	  && (abbrev_has_attr (abbrev, DW_AT_specification)
+	      || abbrev_has_attr (abbrev, DW_AT_abstract_origin)))
+	continue;
+
+      if (has != cond.second)
+	return false;
+    }
+
+  return true;
+}
+
+void
+overloaded_tag_pred_builtin::add_to_filter (die_filter &filter) const
+{
+  filter.add_tag (m_tag, m_positive);
+}
+
+void
+overloaded_atname_pred_builtin::add_to_filter (die_filter &filter) const
+{
+  filter.add_atname (m_atname, m_positive);
+}
+
+std::shared_ptr <overload_tab>
+overloaded_die_producer_builtin::get_overload_tab_followed
+	(std::vector <builtin const *> const &next) const
+{
+  die_filter filter;
+  for (auto bi: next)
+    if (auto fbi = dynamic_cast <die_filter_builtin const *> (bi))
+      fbi->add_to_filter (filter);
+    else if (auto sea = dynamic_cast <str_eq_assertion const *> (bi))
+      {
+	auto abi = dynamic_cast <overloaded_atval_builtin const *>
+	  (&sea->get_word ());
+	if (abi == nullptr || abi->get_atname () != DW_AT_name)
+	  break;
+	filter.add_name (sea->get_str ());
+      }
+    else
+      break;
+
+  if (filter.empty ())
+    return get_overload_tab ();
+  return m_make_tab (filter);
+}
+
+std::shared_ptr <op>
+overloaded_die_producer_builtin::build_exec_followed
+	(layout &l, std::shared_ptr <op> upstream,
+	 std::vector <builtin const *> const &next) const
+{
+  overloaded_op_builtin filtered {name (), get_overload_tab_followed (next)};
+  return filtered.build_exec (l, upstream);
+}
+
+
 // ?FORM_*
 
 pred_form_attr::pred_form_attr (unsigned form)
@@ -30,7 +30,10 @@
 #ifndef _BUILTIN_DW_H_
 #define _BUILTIN_DW_H_
 
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "overload.hh"
 #include "value-dw.hh"
@@ -40,6 +43,137 @@
 struct vocabulary;
 std::unique_ptr <vocabulary> dwgrep_vocabulary_dw ();
 
+// Conditions on DIE's that can be checked on their abbreviations,
+// before values are created for them.  Producers behind entry and
+// child use this to skip DIE's that the predicates right after them
+// would reject anyway.  The predicates still run on DIE's that pass.
+class die_filter
+{
+  std::vector <std::pair <int, bool>> m_tags;
+  std::vector <std::pair <unsigned, bool>> m_atnames;
+  std::vector <std::string> m_names;
+
+public:
+  void add_tag (int tag, bool positive);
+  void add_atname (unsigned atname, bool positive);
+
+  // Condition that @AT_name yields NAME.  The abbreviation can only
+  // tell whether there's a name at all, but `entry` on a Dwarf can
+  // look DIE's up in a name index.
+  void add_name (std::string const &name);
+
+  bool
+  empty () const
+  {
+    return m_tags.empty () && m_atnames.empty () && m_names.empty ();
+  }
+
+  // Return one of the names that DIE's have to have, or nullptr if
+  // there is no such condition.
+  std::string const *
+  name () const
+  {
+    return m_names.empty () ? nullptr : &m_names.front ();
+  }
+
+  // Return false if DIE, yielded with doneness D, certainly doesn't
+  // meet the conditions.
+  bool may_pass (Dwarf_Die &die, doneness d) const;
+};
+
+// Predicate builtins whose condition can be added to a die_filter.
+class die_filter_builtin
+{
+public:
+  virtual ~die_filter_builtin () {}
+  virtual void add_to_filter (die_filter &filter) const = 0;
+};
+
+// ?TAG_* and !TAG_*.
+class overloaded_tag_pred_builtin
+  : public overloaded_pred_builtin
+  , public die_filter_builtin
+{
+  int m_tag;
+
+public:
+  overloaded_tag_pred_builtin (char const *name,
+			       std::shared_ptr <overload_tab> ovl_tab,
+			       bool positive, int tag)
+    : overloaded_pred_builtin {name, ovl_tab, positive}
+    , m_tag {tag}
+  {}
+
+  void add_to_filter (die_filter &filter) const override;
+};
+
+// ?AT_* and !AT_*.
+class overloaded_atname_pred_builtin
+  : public overloaded_pred_builtin
+  , public die_filter_builtin
+{
+  unsigned m_atname;
+
+public:
+  overloaded_atname_pred_builtin (char const *name,
+				  std::shared_ptr <overload_tab> ovl_tab,
+				  bool positive, unsigned atname)
+    : overloaded_pred_builtin {name, ovl_tab, positive}
+    , m_atname {atname}
+  {}
+
+  void add_to_filter (die_filter &filter) const override;
+};
+
+// @AT_*.
+class overloaded_atval_builtin
+  : public overloaded_op_builtin
+{
+  unsigned m_atname;
+
+public:
+  overloaded_atval_builtin (char const *name,
+			    std::shared_ptr <overload_tab> ovl_tab,
+			    unsigned atname)
+    : overloaded_op_builtin {name, ovl_tab}
+    , m_atname {atname}
+  {}
+
+  unsigned
+  get_atname () const
+  {
+    return m_atname;
+  }
+};
+
+// Overloaded builtins that yield DIE's.  MAKE_TAB creates the
+// overload table given a filter for the yielded DIE's.  When the
+// builtin is followed by die_filter_builtin's, or by assertions
+// ?(@AT_name == "STR"), the table is created anew with their
+// conditions.
+class overloaded_die_producer_builtin
+  : public overloaded_op_builtin
+{
+  using make_tab_t
+    = std::function <std::shared_ptr <overload_tab> (die_filter const &)>;
+  make_tab_t m_make_tab;
+
+public:
+  overloaded_die_producer_builtin (char const *name, make_tab_t make_tab)
+    : overloaded_op_builtin {name, make_tab (die_filter {})}
+    , m_make_tab {make_tab}
+  {}
+
+  std::shared_ptr <op>
+  build_exec_followed (layout &l, std::shared_ptr <op> upstream,
+		       std::vector <builtin const *> const &next)
+    const override;
+
+  std::shared_ptr <overload_tab>
+  get_overload_tab_followed (std::vector <builtin const *> const &next)
+    const override;
+};
+
 struct op_dwopen_str
   : public op_once_overload <value_dwarf, value_str>
 {
@@ -81,10 +215,17 @@ struct op_unit_attr
   static std::string docstring ();
 };
 
-struct op_entry_cu
+class op_entry_cu
   : public op_yielding_overload <value_die, value_cu>
 {
-  using op_yielding_overload::op_yielding_overload;
+  die_filter m_filter;
+
+public:
+  op_entry_cu (layout &l, std::shared_ptr <op> upstream,
+	      die_filter filter = die_filter {})
+    : op_yielding_overload {l, upstream}
+    , m_filter {filter}
+  {}
 
   std::unique_ptr <value_producer <value_die>>
   operate (std::unique_ptr <value_cu> a) const override;
@@ -92,10 +233,17 @@ struct op_entry_cu
   static std::string docstring ();
 };
 
-struct op_entry_dwarf
+class op_entry_dwarf
   : public op_yielding_overload <value_die, value_dwarf>
 {
-  using op_yielding_overload::op_yielding_overload;
+  die_filter m_filter;
+
+public:
+  op_entry_dwarf (layout &l, std::shared_ptr <op> upstream,
+		 die_filter filter = die_filter {})
+    : op_yielding_overload {l, upstream}
+    , m_filter {filter}
+  {}
 
   std::unique_ptr <value_producer <value_die>>
   operate (std::unique_ptr <value_dwarf> a) const override;
@@ -103,14 +251,23 @@ struct op_entry_dwarf
   static std::string docstring ();
 };
 
-struct op_child_die
+class op_child_die
   : public op_yielding_overload <value_die, value_die>
 {
-  using op_yielding_overload::op_yielding_overload;
+  die_filter m_filter;
+
+public:
+  op_child_die (layout &l, std::shared_ptr <op> upstream,
+	       die_filter filter = die_filter {})
+    : op_yielding_overload {l, upstream}
+    , m_filter {filter}
+  {}
 
   std::unique_ptr <value_producer <value_die>>
   operate (std::unique_ptr <value_die> a) const override;
 
+  bool exists (std::unique_ptr <value_die> a) const override;
+
   static std::string docstring ();
 };
 
@@ -144,6 +301,8 @@ struct op_attribute_die
   std::unique_ptr <value_producer <value_attr>>
   operate (std::unique_ptr <value_die> a) const override;
 
+  bool exists (std::unique_ptr <value_die> a) const override;
+
   static std::string docstring ();
 };
 
@@ -183,6 +342,18 @@ struct op_address_die
   static std::string docstring ();
 };
 
+struct op_scope_dwarf
+  : public op_yielding_overload <value_die, value_dwarf, value_cst>
+{
+  using op_yielding_overload::op_yielding_overload;
+
+  std::unique_ptr <value_producer <value_die>>
+  operate (std::unique_ptr <value_dwarf> a,
+	   std::unique_ptr <value_cst> b) const override;
+
+  static std::string docstring ();
+};
+
 struct op_address_attr
   : public op_overload <value_cst, value_attr>
 {
@@ -447,7 +618,21 @@ public:
   {}
 
   std::unique_ptr <value_producer <value>>
-  operate (std::unique_ptr <value_die> a) const;
+  operate (std::unique_ptr <value_die> a) const override;
+
+  bool exists (std::unique_ptr <value_die> a) const override;
+
+  static std::string docstring ();
+};
+
+struct op_lookup_dwarf
+  : public op_yielding_overload <value_die, value_dwarf, value_str>
+{
+  using op_yielding_overload::op_yielding_overload;
+
+  std::unique_ptr <value_producer <value_die>>
+  operate (std::unique_ptr <value_dwarf> a,
+	   std::unique_ptr <value_str> b) const override;
 
   static std::string docstring ();
 };
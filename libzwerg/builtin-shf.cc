@@ -29,6 +29,7 @@
 
 #include "builtin-shf.hh"
 #include "op.hh"
+#include "stack_profile.hh"
 
 namespace
 {
@@ -82,6 +83,12 @@ op_drop::docstring ()
   return shf_docstring;
 }
 
+void
+op_drop::stack_effect (stack_profile &sp)
+{
+  sp.shuffle (1, {});
+}
+
 
 stack::uptr
 op_swap::next (scon &sc) const
@@ -109,13 +116,19 @@ op_swap::docstring ()
   return shf_docstring;
 }
 
+void
+op_swap::stack_effect (stack_profile &sp)
+{
+  sp.shuffle (2, {0, 1});
+}
+
 
 stack::uptr
 op_dup::next (scon &sc) const
 {
   if (auto stk = m_upstream->next (sc))
     {
-      stk->push (stk->top ().clone ());
+      stk->dup (0);
       return stk;
     }
   return nullptr;
@@ -133,13 +146,19 @@ op_dup::docstring ()
   return shf_docstring;
 }
 
+void
+op_dup::stack_effect (stack_profile &sp)
+{
+  sp.shuffle (1, {0, 0});
+}
+
 
 stack::uptr
 op_over::next (scon &sc) const
 {
   if (auto stk = m_upstream->next (sc))
     {
-      stk->push (stk->get (1).clone ());
+      stk->dup (1);
       return stk;
     }
   return nullptr;
@@ -157,6 +176,12 @@ op_over::docstring ()
   return shf_docstring;
 }
 
+void
+op_over::stack_effect (stack_profile &sp)
+{
+  sp.shuffle (2, {1, 0, 1});
+}
+
 
 stack::uptr
 op_rot::next (scon &sc) const
@@ -185,3 +210,9 @@ op_rot::docstring ()
 {
   return shf_docstring;
 }
+
+void
+op_rot::stack_effect (stack_profile &sp)
+{
+  sp.shuffle (3, {1, 0, 2});
+}
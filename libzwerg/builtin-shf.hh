@@ -30,6 +30,7 @@
 #ifndef _BUILTIN_SHF_H_
 #define _BUILTIN_SHF_H_
 
+#include "builtin.hh"
 #include "op.hh"
 
 struct op_drop
@@ -40,6 +41,7 @@ struct op_drop
 
   std::string name () const override final;
   static std::string docstring ();
+  static void stack_effect (stack_profile &sp);
 };
 
 struct op_swap
@@ -50,6 +52,7 @@ struct op_swap
 
   std::string name () const override final;
   static std::string docstring ();
+  static void stack_effect (stack_profile &sp);
 };
 
 struct op_dup
@@ -60,6 +63,7 @@ struct op_dup
 
   std::string name () const override final;
   static std::string docstring ();
+  static void stack_effect (stack_profile &sp);
 };
 
 struct op_over
@@ -70,6 +74,7 @@ struct op_over
 
   std::string name () const override final;
   static std::string docstring ();
+  static void stack_effect (stack_profile &sp);
 };
 
 struct op_rot
@@ -80,6 +85,24 @@ struct op_rot
 
   std::string name () const override final;
   static std::string docstring ();
+  static void stack_effect (stack_profile &sp);
+};
+
+// A builtin for one of the above, which unlike other builtins can
+// describe its stack effect precisely: values are moved around, but
+// their types are kept.
+template <class Op>
+class shuffle_builtin
+  : public simple_exec_builtin <Op>
+{
+public:
+  using simple_exec_builtin <Op>::simple_exec_builtin;
+
+  void
+  stack_effect (stack_profile &sp) const override
+  {
+    Op::stack_effect (sp);
+  }
 };
 
 #endif /* _BUILTIN_SHF_H_ */
@@ -35,6 +35,7 @@
 #include "builtin-cst.hh"
 #include "op.hh"
 #include "overload.hh"
+#include "stack_profile.hh"
 #include "value-cst.hh"
 
 std::unique_ptr <pred>
@@ -49,6 +50,13 @@ builtin::build_exec (layout &l, std::shared_ptr <op> upstream) const
   return nullptr;
 }
 
+std::shared_ptr <op>
+builtin::build_exec_followed (layout &l, std::shared_ptr <op> upstream,
+			      std::vector <builtin const *> const &next) const
+{
+  return build_exec (l, upstream);
+}
+
 std::string
 builtin::docstring () const
 {
@@ -61,6 +69,16 @@ builtin::protomap () const
   return {};
 }
 
+void
+builtin::stack_effect (stack_profile &sp) const
+{
+  auto pm = protomap ();
+  if (pm.size () == 1)
+    sp.apply (pm.front ());
+  else
+    sp.clear ();
+}
+
 std::unique_ptr <pred>
 maybe_invert (std::unique_ptr <pred> pred, bool positive)
 {
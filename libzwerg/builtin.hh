@@ -43,6 +43,7 @@
 
 struct pred;
 struct op;
+class stack_profile;
 
 enum class yield
   {
@@ -80,10 +81,24 @@ public:
   virtual std::shared_ptr <op>
   build_exec (layout &l, std::shared_ptr <op> upstream) const;
 
+  // Like build_exec, but NEXT lists builtins that immediately follow
+  // this one in the query.  A builtin can use this to avoid producing
+  // values that following predicates would reject anyway.  Those
+  // builtins are still built and applied as usual.  The default
+  // simply calls build_exec.
+  virtual std::shared_ptr <op>
+  build_exec_followed (layout &l, std::shared_ptr <op> upstream,
+		       std::vector <builtin const *> const &next) const;
+
   virtual char const *name () const = 0;
 
   virtual std::string docstring () const;
   virtual builtin_protomap protomap () const;
+
+  // Update SP with the stack effect of this builtin.  The default
+  // derives it from protomap, if that has a single rule, and
+  // otherwise clears SP.
+  virtual void stack_effect (stack_profile &sp) const;
 };
 
 // Return either PRED, or PRED_NOT(PRED), depending on POSITIVE.
@@ -100,6 +115,46 @@ public:
   explicit pred_builtin (bool positive)
     : m_positive {positive}
   {}
+
+  bool
+  is_positive () const
+  {
+    return m_positive;
+  }
+};
+
+// This describes an assertion ?(WORD == "STR"), where WORD is a
+// builtin, among the builtins passed to build_exec_followed.  It is
+// never built itself, the assertion is built as usual.
+class str_eq_assertion
+  : public builtin
+{
+  builtin const &m_word;
+  std::string m_str;
+
+public:
+  str_eq_assertion (builtin const &word, std::string str)
+    : m_word (word)
+    , m_str {str}
+  {}
+
+  builtin const &
+  get_word () const
+  {
+    return m_word;
+  }
+
+  std::string const &
+  get_str () const
+  {
+    return m_str;
+  }
+
+  char const *
+  name () const override
+  {
+    return "?(== STR)";
+  }
 };
 
 struct vocabulary
@@ -29,44 +29,151 @@
 #include <cassert>
 #include <algorithm>
 #include <memory>
+#include <stdexcept>
 
 #include "cache.hh"
 #include "dwpp.hh"
 #include "dwit.hh"
 
-void
-parent_cache::recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-					 Dwarf_Off paroff)
+namespace
 {
-  while (true)
+  size_t
+  hash_slot (uint32_t key, size_t mask)
+  {
+    return (key * UINT32_C (2654435761)) & mask;
+  }
+
+  uint32_t
+  relative_key (Dwarf_Off off, Dwarf_Off base)
+  {
+    Dwarf_Off rel = off - base + 1;
+    if (rel > UINT32_MAX)
+      throw std::runtime_error ("unit too large for parent cache");
+    return rel;
+  }
+}
+
+parent_cache::unit_cache::unit_cache (Dwarf_Die cudie)
+  : m_base {dwarf_dieoffset (&cudie)}
+  , m_last_use {0}
+{
+  // Walk the unit with an explicit stack, so that deeply nested DIE
+  // trees can't exhaust the call stack.  The stack holds DIE's yet to
+  // be visited together with keys of their parents.
+  std::vector <std::pair <uint32_t, uint32_t>> entries;
+  std::vector <std::pair <Dwarf_Die, uint32_t>> stack;
+  stack.push_back (std::make_pair (cudie, 0));
+
+  while (! stack.empty ())
     {
-      Dwarf_Off off = dwarf_dieoffset (&die);
-      uc.push_back (std::make_pair (off, paroff));
+      Dwarf_Die die = stack.back ().first;
+      uint32_t parkey = stack.back ().second;
+      stack.pop_back ();
 
-      {
-	Dwarf_Die child;
-	if (dwpp_child (die, child))
-	  recursively_populate_unit (uc, child, off);
-      }
+      uint32_t key = relative_key (dwarf_dieoffset (&die), m_base);
+      entries.push_back (std::make_pair (key, parkey));
 
-      switch (dwarf_siblingof (&die, &die))
+      // Push the sibling first, so that children are visited before
+      // it and the stack depth stays bounded by the tree depth.
+      Dwarf_Die sibling;
+      switch (dwarf_siblingof (&die, &sibling))
 	{
 	case 0:
+	  stack.push_back (std::make_pair (sibling, parkey));
 	  break;
 	case -1:
 	  throw_libdw ();
 	case 1:
-	  return;
+	  break;
 	}
+
+      Dwarf_Die child;
+      if (dwpp_child (die, child))
+	stack.push_back (std::make_pair (child, key));
+    }
+
+  // Keep the table at most half full.
+  size_t size = 16;
+  while (size < 2 * entries.size ())
+    size *= 2;
+  m_table.resize (size);
+
+  size_t mask = size - 1;
+  for (auto const &entry: entries)
+    {
+      size_t i = hash_slot (entry.first, mask);
+      while (m_table[i].first != 0)
+	i = (i + 1) & mask;
+      m_table[i] = entry;
     }
 }
 
-parent_cache::unit_cache_t
-parent_cache::populate_unit (Dwarf_Die die)
+Dwarf_Off
+parent_cache::unit_cache::find (Dwarf_Off dieoff) const
 {
-  unit_cache_t uc;
-  recursively_populate_unit (uc, die, no_off);
-  return uc;
+  uint32_t key = relative_key (dieoff, m_base);
+  size_t mask = m_table.size () - 1;
+  for (size_t i = hash_slot (key, mask); m_table[i].first != 0;
+       i = (i + 1) & mask)
+    if (m_table[i].first == key)
+      return m_table[i].second == 0 ? no_off
+	: m_base + m_table[i].second - 1;
+
+  assert (! "DIE not found in its unit");
+  return no_off;
+}
+
+parent_cache::parent_cache (size_t limit)
+  : m_last_dw {nullptr}
+  , m_last {nullptr}
+  , m_tick {0}
+  , m_bytes {0}
+  , m_limit {limit}
+{}
+
+void
+parent_cache::evict ()
+{
+  // Drop units that weren't used for the longest time, but always
+  // keep at least the one that's in use.
+  while (m_bytes > m_limit && m_cache.size () > 1)
+    {
+      auto lru = m_cache.end ();
+      for (auto it = m_cache.begin (); it != m_cache.end (); ++it)
+	if (&it->second != m_last
+	    && (lru == m_cache.end ()
+		|| it->second.m_last_use < lru->second.m_last_use))
+	  lru = it;
+
+      assert (lru != m_cache.end ());
+      m_bytes -= lru->second.bytes ();
+      m_cache.erase (lru);
+    }
+}
+
+parent_cache::unit_cache &
+parent_cache::get_unit (Dwarf *dw, Dwarf_Die cudie)
+{
+  Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
+
+  // Consecutive look-ups tend to come from the same unit.
+  if (m_last == nullptr || m_last_dw != dw || m_last->m_base != cuoff)
+    {
+      auto key = std::make_pair (dw, cuoff);
+      auto it = m_cache.find (key);
+      if (it == m_cache.end ())
+	{
+	  it = m_cache.insert (std::make_pair (key, unit_cache {cudie})).first;
+	  m_bytes += it->second.bytes ();
+	  m_last = &it->second;
+	  evict ();
+	}
+      m_last_dw = dw;
+      m_last = &it->second;
+    }
+
+  m_last->m_last_use = ++m_tick;
+  return *m_last;
 }
 
 Dwarf_Off
@@ -76,25 +183,8 @@ parent_cache::find (Dwarf_Die die)
   if (dwarf_diecu (&die, &cudie, nullptr, nullptr) == nullptr)
     throw_libdw ();
 
-  Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
   Dwarf *dw = dwarf_cu_getdwarf (die.cu);
-  auto key = std::make_pair (dw, cuoff);
-
-  auto it = m_cache.find (key);
-  if (it == m_cache.end ())
-    it = m_cache.insert (std::make_pair (key, populate_unit (cudie))).first;
-
-  Dwarf_Off dieoff = dwarf_dieoffset (&die);
-  auto jt = std::lower_bound
-    (it->second.begin (), it->second.end (), dieoff,
-     [] (std::pair <Dwarf_Off, Dwarf_Off> const &a, Dwarf_Off b)
-     {
-       return a.first < b;
-     });
-
-  assert (jt != it->second.end ());
-  assert (jt->first == dieoff);
-  return jt->second;
+  return get_unit (dw, cudie).find (dwarf_dieoffset (&die));
 }
 
 
@@ -29,7 +29,9 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include <cstdint>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <vector>
@@ -38,18 +40,64 @@
 
 class parent_cache
 {
-  using unit_cache_t = std::vector <std::pair <Dwarf_Off, Dwarf_Off>>;
-  using cache_t = std::map <std::pair <Dwarf *, Dwarf_Off>, unit_cache_t>;
+  // Parents of DIE's in one unit.  This is an open-addressing hash
+  // table keyed by DIE offset.  Offsets are stored relative to the
+  // unit DIE, plus one, so that zero can mark an empty slot and a
+  // missing parent.
+  struct unit_cache
+  {
+    Dwarf_Off m_base;
+    std::vector <std::pair <uint32_t, uint32_t>> m_table;
+    uint64_t m_last_use;
+
+    unit_cache (Dwarf_Die cudie);
+    Dwarf_Off find (Dwarf_Off dieoff) const;
+
+    size_t
+    bytes () const
+    {
+      return sizeof (*this) + m_table.size () * sizeof (m_table[0]);
+    }
+  };
+
+  struct key_hash
+  {
+    size_t
+    operator() (std::pair <Dwarf *, Dwarf_Off> const &key) const
+    {
+      return std::hash <Dwarf *> {} (key.first) ^ key.second;
+    }
+  };
+
+  using cache_t = std::unordered_map <std::pair <Dwarf *, Dwarf_Off>,
+				      unit_cache, key_hash>;
 
   cache_t m_cache;
+  Dwarf *m_last_dw;
+  unit_cache *m_last;
+  uint64_t m_tick;
+  size_t m_bytes;
+  size_t m_limit;
 
-  void recursively_populate_unit (unit_cache_t &uc, Dwarf_Die die,
-				  Dwarf_Off paroff);
-  unit_cache_t populate_unit (Dwarf_Die die);
+  unit_cache &get_unit (Dwarf *dw, Dwarf_Die cudie);
+  void evict ();
 
 public:
   static Dwarf_Off const no_off = (Dwarf_Off) -1;
+
+  // LIMIT is a soft limit on memory taken by the cached units.  When
+  // it's exceeded, units that weren't used for the longest time are
+  // dropped (and rebuilt if they are needed again).
+  explicit parent_cache (size_t limit = 512 << 20);
+
   Dwarf_Off find (Dwarf_Die die);
+
+  // Return the number of bytes currently taken by the cached units.
+  size_t
+  bytes () const
+  {
+    return m_bytes;
+  }
 };
 
 class root_cache
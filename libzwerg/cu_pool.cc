@@ -0,0 +1,50 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include "cu_pool.hh"
+#include "dwmods.hh"
+
+cu_pool::cu_pool (dwfl_context &dwctx)
+  : m_next {0}
+{
+  std::vector <Dwarf *> dwarfs = all_dwarfs (dwctx);
+  for (size_t i = 0; i < dwarfs.size (); ++i)
+    for (cu_iterator it {dwarfs[i]}; it != cu_iterator::end (); ++it)
+      m_cus.push_back ({i, it.offset (), dwarf_dieoffset (*it)});
+}
+
+bool
+cu_pool::take (cu_ref &ref)
+{
+  size_t i = m_next++;
+  if (i >= m_cus.size ())
+    return false;
+
+  ref = m_cus[i];
+  return true;
+}
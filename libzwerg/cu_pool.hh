@@ -0,0 +1,77 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _CU_POOL_H_
+#define _CU_POOL_H_
+
+#include <atomic>
+#include <vector>
+#include <elfutils/libdw.h>
+
+class dwfl_context;
+
+// A list of all units in a Dwarf file, handed out one at a time to
+// whoever asks first.  Several Dwarf values, each opened separately
+// for the same file and used on a thread of its own, can share one
+// pool, and thus split between them a walk through the file's units.
+// A unit is only taken from the pool once the previous one has been
+// processed, so threads that get small units come back for more,
+// and the work balances itself.
+class cu_pool
+{
+public:
+  struct cu_ref
+  {
+    // Index of the Dwarf among all_dwarfs of the context.
+    size_t dwarf_idx;
+
+    // Offset of the unit header, and of the unit DIE.
+    Dwarf_Off cu_offset;
+    Dwarf_Off die_offset;
+  };
+
+private:
+  std::vector <cu_ref> m_cus;
+  std::atomic <size_t> m_next;
+
+public:
+  explicit cu_pool (dwfl_context &dwctx);
+
+  // Take the next unit from the pool and store it to REF.  Returns
+  // false when the pool has been drained.  Can be called from
+  // several threads at once.
+  bool take (cu_ref &ref);
+
+  size_t
+  size () const
+  {
+    return m_cus.size ();
+  }
+};
+
+#endif /* _CU_POOL_H_ */
@@ -0,0 +1,330 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dwarf.h>
+
+#include "die_index.hh"
+#include "dwit.hh"
+#include "dwpp.hh"
+
+// The sidecar starts with this header.  It is followed by columns of
+// DIE offsets, parent offsets and unit offsets, each COUNT 64-bit
+// words.  All numbers are in host byte order.
+struct die_index::header
+{
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t build_id_len;
+  unsigned char build_id[64];
+  uint64_t file_size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t count;
+};
+
+namespace
+{
+  char const g_magic[8] = {'Z', 'W', 'I', 'D', 'X', '\0', '0', '2'};
+  uint32_t const g_byte_order = 0x01020304;
+  std::string g_directory;
+
+  size_t
+  columns_size (uint64_t count)
+  {
+    return count * 3 * sizeof (uint64_t);
+  }
+
+  struct columns
+  {
+    std::vector <uint64_t> offsets;
+    std::vector <uint64_t> parents;
+    std::vector <uint64_t> units;
+
+    void
+    populate (Dwarf_Die cudie)
+    {
+      // Walk the unit with an explicit stack, so that deeply nested
+      // DIE trees can't exhaust the call stack.  The stack holds DIE's
+      // yet to be visited together with offsets of their parents.
+      // Children are visited before siblings, so offsets come out
+      // sorted.
+      Dwarf_Off cuoff = dwarf_dieoffset (&cudie);
+      std::vector <std::pair <Dwarf_Die, Dwarf_Off>> stack;
+      stack.push_back (std::make_pair (cudie, Dwarf_Off (die_index::no_off)));
+
+      while (! stack.empty ())
+	{
+	  Dwarf_Die die = stack.back ().first;
+	  Dwarf_Off paroff = stack.back ().second;
+	  stack.pop_back ();
+
+	  Dwarf_Off off = dwarf_dieoffset (&die);
+	  offsets.push_back (off);
+	  parents.push_back (paroff);
+	  units.push_back (cuoff);
+
+	  Dwarf_Die sibling;
+	  switch (dwarf_siblingof (&die, &sibling))
+	    {
+	    case 0:
+	      stack.push_back (std::make_pair (sibling, paroff));
+	      break;
+	    case -1:
+	      throw_libdw ();
+	    case 1:
+	      break;
+	    }
+
+	  Dwarf_Die child;
+	  if (dwpp_child (die, child))
+	    stack.push_back (std::make_pair (child, off));
+	}
+    }
+  };
+
+  template <class T>
+  char *
+  copy_column (char *dest, std::vector <T> const &col)
+  {
+    size_t size = col.size () * sizeof (T);
+    std::memcpy (dest, col.data (), size);
+    return dest + size;
+  }
+
+  void
+  write_sidecar (std::string const &path, std::vector <char> const &buf)
+  {
+    // Write to a temporary file first and rename it into place, so
+    // that concurrent runs never see a partially-written sidecar.
+    std::string tmpl = path + ".XXXXXX";
+    std::vector <char> tmp {tmpl.begin (), tmpl.end ()};
+    tmp.push_back ('\0');
+
+    int fd = mkstemp (tmp.data ());
+    if (fd == -1)
+      return;
+
+    bool ok = true;
+    for (size_t done = 0; ok && done < buf.size (); )
+      {
+	ssize_t ret = write (fd, buf.data () + done, buf.size () - done);
+	if (ret < 0)
+	  ok = errno == EINTR;
+	else
+	  done += ret;
+      }
+
+    if (close (fd) != 0 || ! ok || rename (tmp.data (), path.c_str ()) != 0)
+      unlink (tmp.data ());
+  }
+}
+
+die_index::die_index ()
+  : m_map {nullptr}
+  , m_map_size {0}
+  , m_count {0}
+  , m_offsets {nullptr}
+  , m_parents {nullptr}
+  , m_units {nullptr}
+{}
+
+die_index::~die_index ()
+{
+  if (m_map != nullptr)
+    munmap (m_map, m_map_size);
+}
+
+bool
+die_index::set_columns (char const *data, size_t size)
+{
+  if (size < sizeof (header))
+    return false;
+
+  auto hdr = reinterpret_cast <header const *> (data);
+  if (size != sizeof (header) + columns_size (hdr->count))
+    return false;
+
+  m_count = hdr->count;
+  data += sizeof (header);
+  m_offsets = reinterpret_cast <uint64_t const *> (data);
+  m_parents = m_offsets + m_count;
+  m_units = m_parents + m_count;
+  return true;
+}
+
+std::unique_ptr <die_index>
+die_index::load (std::string const &path, header const &key)
+{
+  int fd = ::open (path.c_str (), O_RDONLY);
+  if (fd == -1)
+    return nullptr;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat (fd, &st) == 0 && size_t (st.st_size) >= sizeof (header))
+    map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return nullptr;
+
+  std::unique_ptr <die_index> ret {new die_index ()};
+  ret->m_map = map;
+  ret->m_map_size = st.st_size;
+
+  // Everything but the sizes of the columns has to match the key.
+  auto hdr = static_cast <header const *> (map);
+  if (std::memcmp (hdr, &key, offsetof (header, count)) != 0
+      || ! ret->set_columns (static_cast <char const *> (map), st.st_size))
+    return nullptr;
+
+  return ret;
+}
+
+std::unique_ptr <die_index>
+die_index::build (Dwarf *dw, header const &key)
+{
+  columns cols;
+  for (auto it = cu_iterator {dw}; it != cu_iterator::end (); ++it)
+    cols.populate (**it);
+
+  header hdr = key;
+  hdr.count = cols.offsets.size ();
+
+  std::unique_ptr <die_index> ret {new die_index ()};
+  ret->m_buf.resize (sizeof (header) + columns_size (hdr.count));
+
+  char *ptr = ret->m_buf.data ();
+  std::memcpy (ptr, &hdr, sizeof (hdr));
+  ptr += sizeof (hdr);
+  ptr = copy_column (ptr, cols.offsets);
+  ptr = copy_column (ptr, cols.parents);
+  copy_column (ptr, cols.units);
+
+  bool ok = ret->set_columns (ret->m_buf.data (), ret->m_buf.size ());
+  assert (ok);
+  (void) ok;
+
+  return ret;
+}
+
+void
+die_index::set_directory (std::string const &dir)
+{
+  g_directory = dir;
+}
+
+bool
+die_index::enabled ()
+{
+  return ! g_directory.empty ();
+}
+
+std::unique_ptr <die_index>
+die_index::open (Dwfl_Module *mod)
+{
+  if (! enabled ())
+    return nullptr;
+
+  unsigned char const *bits;
+  GElf_Addr vaddr;
+  int len = dwfl_module_build_id (mod, &bits, &vaddr);
+
+  header key;
+  std::memset (&key, 0, sizeof (key));
+  if (len <= 0 || size_t (len) > sizeof (key.build_id))
+    return nullptr;
+
+  Dwarf_Addr bias;
+  Dwarf *dw = dwfl_module_getdwarf (mod, &bias);
+  if (dw == nullptr)
+    return nullptr;
+
+  char const *mainfile = nullptr;
+  char const *debugfile = nullptr;
+  dwfl_module_info (mod, nullptr, nullptr, nullptr, nullptr, nullptr,
+		    &mainfile, &debugfile);
+  char const *fn = debugfile != nullptr ? debugfile : mainfile;
+
+  struct stat st;
+  if (fn == nullptr || stat (fn, &st) != 0)
+    return nullptr;
+
+  std::memcpy (key.magic, g_magic, sizeof (g_magic));
+  key.byte_order = g_byte_order;
+  key.build_id_len = len;
+  std::memcpy (key.build_id, bits, len);
+  key.file_size = st.st_size;
+  key.mtime_sec = st.st_mtim.tv_sec;
+  key.mtime_nsec = st.st_mtim.tv_nsec;
+
+  std::string path = g_directory + "/";
+  for (int i = 0; i < len; ++i)
+    {
+      static char const digits[] = "0123456789abcdef";
+      path += digits[bits[i] >> 4];
+      path += digits[bits[i] & 0xf];
+    }
+  path += ".zwidx";
+
+  if (auto ret = load (path, key))
+    return ret;
+
+  auto ret = build (dw, key);
+  write_sidecar (path, ret->m_buf);
+  return ret;
+}
+
+bool
+die_index::find (Dwarf_Die die, size_t &idx) const
+{
+  Dwarf_Off off = dwarf_dieoffset (&die);
+  auto it = std::lower_bound (m_offsets, m_offsets + m_count, off);
+  if (it == m_offsets + m_count || *it != off)
+    return false;
+
+  // DIE's from .debug_types have offsets of their own, and both the
+  // DIE offset and the unit offset may collide with those that were
+  // indexed.  Check that DIE belongs to the very unit that was
+  // indexed, which libdw represents by a single Dwarf_CU.
+  idx = it - m_offsets;
+  Dwarf_Die cudie;
+  return dwarf_offdie (dwarf_cu_getdwarf (die.cu), m_units[idx],
+		       &cudie) != nullptr
+    && cudie.cu == die.cu;
+}
@@ -0,0 +1,115 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _DIE_INDEX_H_
+#define _DIE_INDEX_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <elfutils/libdwfl.h>
+
+// An index of all DIE's in .debug_info of one Dwarf.  For each DIE,
+// it records its offset, and offsets of its parent and of its unit
+// DIE.  The data are kept in columns, sorted by DIE offset, and
+// stored in a sidecar file in a directory set by set_directory.  On
+// later runs, the sidecar is memory-mapped instead of walking the
+// Dwarf again.  Sidecars are keyed on build ID of the module, and on
+// size and modification time of the file that holds its debug info.
+class die_index
+{
+  struct header;
+
+  void *m_map;
+  size_t m_map_size;
+  std::vector <char> m_buf;
+
+  size_t m_count;
+  uint64_t const *m_offsets;
+  uint64_t const *m_parents;
+  uint64_t const *m_units;
+
+  die_index ();
+  bool set_columns (char const *data, size_t size);
+
+  static std::unique_ptr <die_index> load (std::string const &path,
+					   header const &key);
+  static std::unique_ptr <die_index> build (Dwarf *dw, header const &key);
+
+public:
+  static Dwarf_Off const no_off = (Dwarf_Off) -1;
+
+  ~die_index ();
+  die_index (die_index const &that) = delete;
+
+  // Set a directory where sidecar files are looked up and created.
+  // An empty string (the default) disables indexing.  This is a
+  // process-wide setting and should be done before any queries run.
+  static void set_directory (std::string const &dir);
+  static bool enabled ();
+
+  // Return an index for Dwarf of module MOD.  The index is loaded
+  // from a sidecar file if a fresh one exists, otherwise it's built
+  // and the sidecar is written.  Returns nullptr if indexing is
+  // disabled, or the module can't be indexed, e.g. because it has
+  // no build ID.
+  static std::unique_ptr <die_index> open (Dwfl_Module *mod);
+
+  // Find DIE in the index.  Stores its position to IDX and returns
+  // true if found.  DIE's of type units in .debug_types are never
+  // found.
+  bool find (Dwarf_Die die, size_t &idx) const;
+
+  size_t
+  size () const
+  {
+    return m_count;
+  }
+
+  Dwarf_Off
+  offset (size_t idx) const
+  {
+    return m_offsets[idx];
+  }
+
+  // Offset of the parent DIE, or no_off for unit DIE's.
+  Dwarf_Off
+  parent (size_t idx) const
+  {
+    return m_parents[idx];
+  }
+
+  Dwarf_Off
+  unit (size_t idx) const
+  {
+    return m_units[idx];
+  }
+};
+
+#endif /* _DIE_INDEX_H_ */
@@ -338,7 +338,7 @@ string_or_unknown (const char *known, const char *prefix, brevity brv,
                    unsigned int lo_user, unsigned int hi_user,
 		   bool print_unknown_num)
 {
-  static char unknown_buf[40];
+  static thread_local char unknown_buf[40];
 
   if (known != nullptr)
     return known;
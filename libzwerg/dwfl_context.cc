@@ -28,23 +28,69 @@
 
 #include "std-memory.hh"
 #include "dwfl_context.hh"
+#include "addr_index.hh"
 #include "cache.hh"
+#include "die_index.hh"
 #include "dwit.hh"
+#include "dwmods.hh"
+#include "name_index.hh"
 
 struct dwfl_context::pimpl
 {
   parent_cache m_parcache;
   root_cache m_rootcache;
 
+  // DIE indices of individual Dwarfs.  A null pointer is stored for
+  // Dwarfs that can't be indexed.
+  std::map <Dwarf *, std::unique_ptr <die_index>> m_indices;
+
+  std::unique_ptr <addr_index> m_addr_index;
+  std::unique_ptr <name_index> m_name_index;
+
+  die_index const *
+  get_index (Dwfl *dwfl, Dwarf_Die die)
+  {
+    Dwarf *dw = dwarf_cu_getdwarf (die.cu);
+    auto it = m_indices.find (dw);
+    if (it == m_indices.end ())
+      {
+	std::unique_ptr <die_index> idx;
+	Dwarf_Addr bias;
+	for (auto jt = dwfl_module_iterator {dwfl};
+	     jt != dwfl_module_iterator::end (); ++jt)
+	  if (dwfl_module_getdwarf (*jt, &bias) == dw)
+	    {
+	      idx = die_index::open (*jt);
+	      break;
+	    }
+
+	it = m_indices.insert (std::make_pair (dw, std::move (idx))).first;
+      }
+
+    return it->second.get ();
+  }
+
   Dwarf_Off
-  find_parent (Dwarf_Die die)
+  find_parent (Dwfl *dwfl, Dwarf_Die die)
   {
+    size_t i;
+    if (die_index::enabled ())
+      if (die_index const *idx = get_index (dwfl, die))
+	if (idx->find (die, i))
+	  return idx->parent (i);
+
     return m_parcache.find (die);
   }
 
   bool
-  is_root (Dwarf_Die die)
+  is_root (Dwfl *dwfl, Dwarf_Die die)
   {
+    size_t i;
+    if (die_index::enabled ())
+      if (die_index const *idx = get_index (dwfl, die))
+	if (idx->find (die, i))
+	  return idx->parent (i) == die_index::no_off;
+
     return m_rootcache.is_root (die);
   }
 };
@@ -60,13 +106,29 @@ dwfl_context::~dwfl_context ()
 Dwarf_Off
 dwfl_context::find_parent (Dwarf_Die die)
 {
-  return m_pimpl->find_parent (die);
+  return m_pimpl->find_parent (get_dwfl (), die);
 }
 
 bool
 dwfl_context::is_root (Dwarf_Die die)
 {
-  return m_pimpl->is_root (die);
+  return m_pimpl->is_root (get_dwfl (), die);
+}
+
+addr_index &
+dwfl_context::get_addr_index ()
+{
+  if (m_pimpl->m_addr_index == nullptr)
+    m_pimpl->m_addr_index = std::make_unique <addr_index> (all_dwarfs (*this));
+  return *m_pimpl->m_addr_index;
+}
+
+name_index &
+dwfl_context::get_name_index ()
+{
+  if (m_pimpl->m_name_index == nullptr)
+    m_pimpl->m_name_index = std::make_unique <name_index> (all_dwarfs (*this));
+  return *m_pimpl->m_name_index;
 }
 
 int
@@ -32,6 +32,9 @@
 #include <memory>
 #include <elfutils/libdwfl.h>
 
+class addr_index;
+class name_index;
+
 // This represents a Dwfl handle together with some query caches.
 class dwfl_context
 {
@@ -49,6 +52,10 @@ public:
   Dwarf_Off find_parent (Dwarf_Die die);
   bool is_root (Dwarf_Die die);
   int get_machine () const;
+
+  // These indices are built on first use.
+  addr_index &get_addr_index ();
+  name_index &get_name_index ();
 };
 
 #endif /* _DWFL_CONTEXT_H_ */
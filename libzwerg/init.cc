@@ -36,6 +36,7 @@
 #include "value-seq.hh"
 #include "value-str.hh"
 
+#include "builtin-agg.hh"
 #include "builtin-closure.hh"
 #include "builtin-cmp.hh"
 #include "builtin-cst.hh"
@@ -99,11 +100,11 @@ dwgrep_vocabulary_core ()
   voc->add (std::make_shared <simple_exec_builtin <op_pos>> ("pos"));
 
   // stack shuffling
-  voc->add (std::make_shared <simple_exec_builtin <op_drop>> ("drop"));
-  voc->add (std::make_shared <simple_exec_builtin <op_swap>> ("swap"));
-  voc->add (std::make_shared <simple_exec_builtin <op_dup>> ("dup"));
-  voc->add (std::make_shared <simple_exec_builtin <op_over>> ("over"));
-  voc->add (std::make_shared <simple_exec_builtin <op_rot>> ("rot"));
+  voc->add (std::make_shared <shuffle_builtin <op_drop>> ("drop"));
+  voc->add (std::make_shared <shuffle_builtin <op_swap>> ("swap"));
+  voc->add (std::make_shared <shuffle_builtin <op_dup>> ("dup"));
+  voc->add (std::make_shared <shuffle_builtin <op_over>> ("over"));
+  voc->add (std::make_shared <shuffle_builtin <op_rot>> ("rot"));
 
   // "add"
   {
@@ -230,11 +231,46 @@ dwgrep_vocabulary_core ()
     auto t = std::make_shared <overload_tab> ();
 
     t->add_op_overload <op_length_str> ();
-    t->add_op_overload <op_length_seq> ();
+    add_aggregate_overload <agg_count> (*t);
 
     voc->add (std::make_shared <overloaded_op_builtin> ("length", t));
   }
 
+  // "sum"
+  {
+    auto t = std::make_shared <overload_tab> ();
+    add_aggregate_overload <agg_sum> (*t);
+    voc->add (std::make_shared <overloaded_op_builtin> ("sum", t));
+  }
+
+  // "min"
+  {
+    auto t = std::make_shared <overload_tab> ();
+    add_aggregate_overload <agg_min> (*t);
+    voc->add (std::make_shared <overloaded_op_builtin> ("min", t));
+  }
+
+  // "max"
+  {
+    auto t = std::make_shared <overload_tab> ();
+    add_aggregate_overload <agg_max> (*t);
+    voc->add (std::make_shared <overloaded_op_builtin> ("max", t));
+  }
+
+  // "distinct"
+  {
+    auto t = std::make_shared <overload_tab> ();
+    add_aggregate_overload <agg_distinct> (*t);
+    voc->add (std::make_shared <overloaded_op_builtin> ("distinct", t));
+  }
+
+  // "histogram"
+  {
+    auto t = std::make_shared <overload_tab> ();
+    add_aggregate_overload <agg_histogram> (*t);
+    voc->add (std::make_shared <overloaded_op_builtin> ("histogram", t));
+  }
+
   // "value"
   {
     auto t = std::make_shared <overload_tab> ();
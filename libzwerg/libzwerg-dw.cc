@@ -30,9 +30,13 @@
 #include "libzwerg-dw.h"
 #include "libzwerg.hh"
 
+#include "atval.hh"
 #include "builtin-dw.hh"
+#include "cu_pool.hh"
+#include "die_index.hh"
 #include "value-aset.hh"
 #include "value-dw.hh"
+#include "value-seq.hh"
 #include "value-symbol.hh"
 #include "dwcst.hh"
 
@@ -307,6 +311,85 @@ zw_value_dwarf_machine (zw_value const *val, zw_error **out_err)
 }
 
 
+zw_cu_pool *
+zw_cu_pool_init (zw_value const *dw, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      auto pool = std::make_shared <cu_pool> (*dwarf (dw).get_dwctx ());
+      return new zw_cu_pool {pool};
+    }, nullptr, out_err);
+}
+
+void
+zw_cu_pool_destroy (zw_cu_pool *pool)
+{
+  delete pool;
+}
+
+zw_value *
+zw_value_init_dwarf_pooled (zw_value const *dw, zw_cu_pool *pool,
+			    size_t pos, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      value_dwarf const &orig = dwarf (dw);
+      auto ret = std::make_unique <value_dwarf> (orig.get_fn (), pos,
+						 orig.get_doneness ());
+      ret->set_cu_pool (pool->m_pool);
+      return ret.release ();
+    }, nullptr, out_err);
+}
+
+namespace
+{
+  // Whether T binds NAME anywhere.
+  bool
+  binds (tree const &t, std::string const &name)
+  {
+    if (t.tt () == tree_type::BIND && t.str () == name)
+      return true;
+    for (auto const &ch: t.m_children)
+      if (binds (ch, name))
+	return true;
+    return false;
+  }
+}
+
+bool
+zw_query_splits_over_units (zw_vocabulary const *voc, zw_query const *query)
+{
+  tree const *head = &query->m_tree;
+  while (head->tt () == tree_type::CAT && ! head->m_children.empty ())
+    head = &head->child (0);
+
+  // The parser emits words as READ nodes.  Those are looked up in
+  // VOC, unless the query binds the same name somewhere.
+  std::shared_ptr <builtin const> bi;
+  if (head->tt () == tree_type::F_BUILTIN)
+    bi = head->m_builtin;
+  else if (head->tt () == tree_type::READ
+	   && ! binds (query->m_tree, head->str ()))
+    bi = voc->m_voc->find (head->str ());
+
+  if (bi == nullptr)
+    return false;
+
+  vocabulary const &dw = *zw_vocabulary_dwarf (zw_throw_on_error {})->m_voc;
+  return bi == dw.find ("unit") || bi == dw.find ("entry");
+}
+
+void
+zw_dwarf_index_set_dir (char const *dir)
+{
+  die_index::set_directory (dir != nullptr ? dir : "");
+}
+
+void
+zw_dwarf_cache_set_size (size_t size)
+{
+  value_dwarf::set_cache_size (size);
+}
+
+
 namespace
 {
   value_cu const &
@@ -376,6 +459,37 @@ zw_value_attr_dwarf (zw_value const *val, zw_error **out_err)
     }, nullptr, out_err);
 }
 
+namespace
+{
+  zw_value *
+  attr_values (value_die const &die, Dwarf_Attribute at)
+  {
+    value_seq::seq_t vals;
+    if (auto prod = at_value (die.get_dwctx (), die, at))
+      while (auto val = prod->next ())
+	vals.push_back (std::move (val));
+    return std::make_unique <value_seq> (std::move (vals), 0).release ();
+  }
+}
+
+zw_value *
+zw_value_attr_values (zw_value const *val, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      value_attr const &a = attr (val);
+      return attr_values (a.get_value_die (), a.get_attr ());
+    }, nullptr, out_err);
+}
+
+zw_value *
+zw_value_die_attr_values (zw_value const *val, Dwarf_Attribute const *at,
+			  zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      return attr_values (die (val), *at);
+    }, nullptr, out_err);
+}
+
 
 namespace
 {
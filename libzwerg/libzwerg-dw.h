@@ -251,6 +251,19 @@ extern "C" {
   zw_value const *zw_value_attr_dwarf (zw_value const *attr,
 				       zw_error **out_err);
 
+  // Return a sequence of values that ATTR, which shall be an
+  // attribute value, has.  These are the same values that the word
+  // "value" yields.  Returns NULL on error, in which case it sets
+  // *OUT_ERR.  OUT_ERR shall be non-NULL.
+  zw_value *zw_value_attr_values (zw_value const *attr, zw_error **out_err);
+
+  // Like zw_value_attr_values, but for attribute AT found at DIE,
+  // which shall be a DIE value.  This avoids creating an attribute
+  // value when walking attributes of a DIE through libdw.
+  zw_value *zw_value_die_attr_values (zw_value const *die,
+				      Dwarf_Attribute const *at,
+				      zw_error **out_err);
+
 
   /**
    * Location list element.
@@ -352,6 +365,67 @@ extern "C" {
 					 zw_error **out_err);
 
 
+  /**
+   * Splitting a query over units.
+   */
+
+  // Objects of type zw_cu_pool hold a list of units of a Dwarf file,
+  // which several threads can take from as they go, and thus split
+  // the work of a single query between them.
+  typedef struct zw_cu_pool zw_cu_pool;
+
+  // Create a pool with all units of DW, which shall be a DWARF (ELF)
+  // value.  Returns NULL on error, in which case it sets *OUT_ERR.
+  // OUT_ERR shall be non-NULL.
+  zw_cu_pool *zw_cu_pool_init (zw_value const *dw, zw_error **out_err);
+
+  // Release any resources associated with POOL.  Values created by
+  // zw_value_init_dwarf_pooled keep the pool alive as long as they
+  // need it.
+  void zw_cu_pool_destroy (zw_cu_pool *pool);
+
+  // Open anew the file that DW was created from, and return a value
+  // such that the words "unit" and "entry" applied to it only visit
+  // units taken from POOL.  DW shall be a value created by
+  // zw_value_init_dwarf or zw_value_init_dwarf_raw, and POOL shall
+  // have been created from DW.  Each such value has a Dwfl of its
+  // own, and can thus be used on a thread different from other such
+  // values.  The produced value will have a position of POS.
+  // Returns NULL on error, in which case it sets *OUT_ERR.  OUT_ERR
+  // shall be non-NULL.
+  zw_value *zw_value_init_dwarf_pooled (zw_value const *dw,
+					zw_cu_pool *pool, size_t pos,
+					zw_error **out_err);
+
+  // Return whether the first word of QUERY, which was parsed with
+  // VOC, is the word "unit" or "entry" of zw_vocabulary_dwarf.
+  // Running such a query on each of several values created by
+  // zw_value_init_dwarf_pooled over a single pool yields, taken
+  // together, the same stacks as running it on the original value,
+  // though possibly in a different order and with different
+  // positions.
+  bool zw_query_splits_over_units (zw_vocabulary const *voc,
+				   zw_query const *query);
+
+  // Keep indices of DWARF files in DIR.  When set, an index of DIE
+  // parents is built for each module with a build ID the first time
+  // that queries need it, and saved to DIR.  It speeds up the words
+  // parent and ?root.  Later
+  // runs over the same, unchanged file load the saved index instead
+  // of walking the Dwarf.  Passing NULL or an empty string disables
+  // indexing, which is the default.  This is a process-wide setting
+  // and shall not be changed while queries are running.
+  void zw_dwarf_index_set_dir (char const *dir);
+
+  // Dwarf values that refer to the same, unchanged file and are
+  // created on the same thread share the opened file and the caches
+  // associated with it.  Additionally, up to SIZE of the most recently
+  // opened files are kept open on each thread after the last value
+  // referring to them is destroyed, so that reopening them is cheap.
+  // The default is 8.  This is a process-wide setting.
+  void zw_dwarf_cache_set_size (size_t size);
+
+
 #ifdef __cplusplus
 }
 #endif
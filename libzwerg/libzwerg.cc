@@ -149,20 +149,60 @@ zw_query_parse (zw_vocabulary const *voc, char const *query,
   return zw_query_parse_len (voc, query, strlen (query), out_err);
 }
 
+namespace
+{
+  zw_query *
+  build_query (zw_vocabulary const *voc, char const *query, size_t query_len,
+	       bool explain, zw_error **out_err)
+  {
+    return capture_errors ([&] () {
+	tree t = parse_query ({query, query_len});
+	t.simplify ();
+	t.optimize (*voc->m_voc);
+
+	layout l;
+	auto origin = std::make_shared <op_origin> (l);
+	build_stats stats;
+	std::shared_ptr <query_plan> plan;
+	if (explain)
+	  {
+	    plan = std::make_shared <query_plan> ();
+	    stats.plan = plan.get ();
+	  }
+	auto op = t.build_exec (l, origin, *voc->m_voc, &stats);
+
+	return new zw_query {t, l, *origin, op, stats, plan};
+      }, nullptr, out_err);
+  }
+}
+
 zw_query *
 zw_query_parse_len (zw_vocabulary const *voc,
 		    char const *query, size_t query_len,
 		    zw_error **out_err)
 {
-  return capture_errors ([&] () {
-      tree t = parse_query ({query, query_len});
-      t.simplify ();
+  return build_query (voc, query, query_len, false, out_err);
+}
 
-      layout l;
-      auto origin = std::make_shared <op_origin> (l);
-      auto op = t.build_exec (l, origin, *voc->m_voc);
+zw_query *
+zw_query_parse_explain (zw_vocabulary const *voc,
+			char const *query, size_t query_len,
+			zw_error **out_err)
+{
+  return build_query (voc, query, query_len, true, out_err);
+}
+
+zw_value *
+zw_query_explain (zw_query const *query, bool analyze, zw_error **out_err)
+{
+  return capture_errors ([&] () {
+      if (query->m_plan == nullptr)
+	throw std::runtime_error
+	  ("query was not parsed with zw_query_parse_explain");
 
-      return new zw_query {l, *origin, op};
+      std::stringstream ss;
+      query->m_plan->dump (ss, analyze);
+      return new value_str {ss.str (), 0};
     }, nullptr, out_err);
 }
 
@@ -172,6 +212,25 @@ zw_query_destroy (zw_query *query)
   delete query;
 }
 
+size_t
+zw_query_pegged_overloads (zw_query const *query)
+{
+  return query->m_stats.pegged;
+}
+
+size_t
+zw_query_dispatched_overloads (zw_query const *query)
+{
+  return query->m_stats.dispatched;
+}
+
+bool
+zw_query_stack_need (zw_query const *query, size_t *out_need)
+{
+  *out_need = query->m_stats.stack_need;
+  return query->m_stats.stack_need_known;
+}
+
 size_t
 zw_value_pos (zw_value const *value)
 {
@@ -200,7 +259,15 @@ zw_query_execute (zw_query const *query, zw_stack const *input_stack,
 		  zw_error **out_err)
 {
   return capture_errors ([&] () {
+      size_t need = query->m_stats.stack_need;
+      if (input_stack->m_values.size () < need)
+	throw std::runtime_error
+	  ("stack overflow: query needs " + std::to_string (need)
+	   + " values on input stack, "
+	   + std::to_string (input_stack->m_values.size ()) + " given");
+
       auto stk = std::make_unique <stack> ();
+      stk->set_checked (! query->m_stats.stack_need_known);
       for (auto const &emt: input_stack->m_values)
 	stk->push (emt->clone ());
 
@@ -317,6 +384,49 @@ zw_value_const_format_brief (zw_value const *val, zw_error **out_err)
   return format_constant (val, brevity::brief, out_err);
 }
 
+namespace
+{
+  // A stream buffer that writes to a fixed array and only counts
+  // what doesn't fit.
+  class fixed_outbuf
+    : public std::streambuf
+  {
+    size_t m_dropped;
+
+  public:
+    fixed_outbuf (char *buf, size_t size)
+      : m_dropped {0}
+    {
+      setp (buf, buf + size);
+    }
+
+    size_t
+    length () const
+    {
+      return pptr () - pbase () + m_dropped;
+    }
+
+  protected:
+    int_type
+    overflow (int_type c) override
+    {
+      if (! traits_type::eq_int_type (c, traits_type::eof ()))
+	++m_dropped;
+      return traits_type::not_eof (c);
+    }
+  };
+}
+
+size_t
+zw_value_const_format_buf (zw_value const *val, char *buf, size_t size)
+{
+  auto cst = extract_constant (val);
+  fixed_outbuf sb {buf, size};
+  std::ostream os {&sb};
+  os << constant {cst.value (), cst.dom (), brevity::full};
+  return sb.length ();
+}
+
 char const *
 zw_cdom_name (zw_cdom const *cdom)
 {
@@ -199,6 +199,43 @@ extern "C" {
   // Release resources associated with QUERY.
   void zw_query_destroy (zw_query *query);
 
+  // Like zw_query_parse_len, but QUERY is built such that it can be
+  // described by zw_query_explain.  Each op of such a query counts
+  // stacks that pass through it and time spent producing them, which
+  // makes it somewhat slower to run.
+  zw_query *zw_query_parse_explain (zw_vocabulary const *voc,
+				    char const *query, size_t query_len,
+				    zw_error **out_err);
+
+  // Return a string value that describes ops that QUERY is built of,
+  // one per line, with ops that run sub-expressions followed by the
+  // indented ops of those sub-expressions.  QUERY shall have been
+  // parsed by zw_query_parse_explain.  If ANALYZE, each line also
+  // shows how many stacks got in and out of the op, how many times
+  // it was asked for one, and the time that took, including time
+  // spent in ops further upstream.  Counts cover results of QUERY
+  // that have been destroyed so far.  The returned value must
+  // eventually be destroyed by the caller.  Returns NULL on error,
+  // in which case it sets *OUT_ERR.  OUT_ERR shall be non-NULL.
+  zw_value *zw_query_explain (zw_query const *query, bool analyze,
+			      zw_error **out_err);
+
+  // Return the number of uses of overloaded words in QUERY that were
+  // bound to a single overload when QUERY was parsed, because types
+  // of their operands were known at that point.
+  size_t zw_query_pegged_overloads (zw_query const *query);
+
+  // Return the number of uses of overloaded words in QUERY that look
+  // up the overload to use at runtime.
+  size_t zw_query_dispatched_overloads (zw_query const *query);
+
+  // Store to *OUT_NEED the number of values that QUERY needs on its
+  // input stack.  zw_query_execute refuses input stacks that are
+  // shallower than that.  Returns false if stack effect of some part
+  // of QUERY could not be determined, in which case the query may in
+  // fact need more values than *OUT_NEED.
+  bool zw_query_stack_need (zw_query const *query, size_t *out_need);
+
   // Run a QUERY on a given INPUT STACK.  Returns a result set from
   // which individual resulting stacks can be pulled.  Returns NULL on
   // error, in which case it sets *OUT_ERR.  OUT_ERR shall be
@@ -283,6 +320,14 @@ extern "C" {
   zw_value *zw_value_const_format_brief (zw_value const *cst,
 					 zw_error **out_err);
 
+  // Like zw_value_const_format, but writes the formatted text to BUF,
+  // which has room for SIZE bytes, instead of allocating a string
+  // value for it.  The text is not NUL-terminated.  Returns the
+  // length of the whole text, which may exceed SIZE, in which case
+  // only the first SIZE bytes were written.
+  size_t zw_value_const_format_buf (zw_value const *cst,
+				    char *buf, size_t size);
+
   // Return a domain associated with CST, which shall be integral
   // constant value.
   zw_cdom const *zw_value_const_dom (zw_value const *cst);
@@ -34,10 +34,13 @@
 #include <iostream>
 
 #include "scon.hh"
+#include "stack_profile.hh"
 #include "tree.hh"
 #include "op.hh"
+#include "plan.hh"
 
 struct vocabulary;
+class cu_pool;
 
 struct zw_error
 {
@@ -51,9 +54,19 @@ struct zw_vocabulary
 
 struct zw_query
 {
+  tree m_tree;
   layout m_l;
   op_origin &m_origin;
   std::shared_ptr <op> m_op;
+  build_stats m_stats;
+
+  // Ops of the query, if it was parsed for explaining.
+  std::shared_ptr <query_plan> m_plan;
+};
+
+struct zw_cu_pool
+{
+  std::shared_ptr <cu_pool> m_pool;
 };
 
 struct zw_result
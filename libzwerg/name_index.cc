@@ -0,0 +1,102 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <cstring>
+#include <dwarf.h>
+
+#include "name_index.hh"
+#include "dwit.hh"
+
+namespace
+{
+  void
+  collect_names (Dwarf_Die die, std::vector <char const *> &names,
+		 unsigned depth = 0)
+  {
+    Dwarf_Attribute at;
+    if (dwarf_attr (&die, DW_AT_name, &at) != nullptr)
+      {
+	char const *name = dwarf_formstring (&at);
+	if (name != nullptr
+	    && std::find_if (names.begin (), names.end (),
+			     [name] (char const *other)
+			     { return std::strcmp (name, other) == 0; })
+		== names.end ())
+	  names.push_back (name);
+	return;
+      }
+
+    // Don't loop forever on cycles of references.
+    if (depth > 16)
+      return;
+
+    for (int atname: {DW_AT_specification, DW_AT_abstract_origin})
+      {
+	Dwarf_Die ref;
+	if (dwarf_attr (&die, atname, &at) != nullptr
+	    && dwarf_formref_die (&at, &ref) != nullptr)
+	  collect_names (ref, names, depth + 1);
+      }
+  }
+}
+
+name_index::name_index (std::vector <Dwarf *> const &dwarfs)
+  : m_imports {false}
+{
+  size_t pos = 0;
+  std::vector <char const *> names;
+  for (Dwarf *dw: dwarfs)
+    for (cu_iterator it {dw}; it != cu_iterator::end (); )
+      {
+	if (dwarf_tag (*it) == DW_TAG_partial_unit)
+	  m_imports = true;
+
+	all_dies_iterator a {it};
+	all_dies_iterator e {++it};
+	for (; a != e; ++a)
+	  {
+	    Dwarf_Die *die = *a;
+	    if (dwarf_tag (die) == DW_TAG_imported_unit)
+	      m_imports = true;
+
+	    names.clear ();
+	    collect_names (*die, names);
+	    for (char const *name: names)
+	      m_entries[name].push_back ({dw, dwarf_dieoffset (die), pos});
+	    ++pos;
+	  }
+      }
+}
+
+std::vector <name_index::entry> const *
+name_index::find (std::string const &name) const
+{
+  auto it = m_entries.find (name);
+  return it != m_entries.end () ? &it->second : nullptr;
+}
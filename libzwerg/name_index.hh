@@ -0,0 +1,77 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _NAME_INDEX_H_
+#define _NAME_INDEX_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <elfutils/libdw.h>
+
+// An index of DIE's by name, built once per Dwarf context by walking
+// all its DIE's.  DIE's are indexed under their own DW_AT_name, or if
+// they have none, under names found through DW_AT_specification and
+// DW_AT_abstract_origin.  A look-up thus yields all DIE's for which
+// @AT_name may produce the given string, in raw as well as cooked
+// mode, and possibly a couple more.
+class name_index
+{
+public:
+  struct entry
+  {
+    Dwarf *dw;
+    Dwarf_Off offset;
+
+    // Position of the DIE among all DIE's of the context, in the
+    // order in which `entry` yields them from a Dwarf.
+    size_t pos;
+  };
+
+private:
+  std::unordered_map <std::string, std::vector <entry>> m_entries;
+  bool m_imports;
+
+public:
+  explicit name_index (std::vector <Dwarf *> const &dwarfs);
+
+  // Whether there are partial units or DW_TAG_imported_unit's.
+  // Cooked walks skip the former and inline the latter, and the
+  // recorded positions don't apply to them.
+  bool
+  has_imports () const
+  {
+    return m_imports;
+  }
+
+  // Return DIE's indexed under NAME, ordered by position, or nullptr
+  // if there are none.
+  std::vector <entry> const *find (std::string const &name) const;
+};
+
+#endif /* _NAME_INDEX_H_ */
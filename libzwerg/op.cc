@@ -30,7 +30,7 @@
 #include <iostream>
 #include <sstream>
 #include <memory>
-#include <set>
+#include <vector>
 #include <algorithm>
 #include "../extern/optional.hpp"
 
@@ -61,6 +61,19 @@ namespace
   }
 }
 
+void
+op::state_reset (scon &sc) const
+{
+  state_des (sc);
+  state_con (sc);
+}
+
+bool
+op::probe (scon &sc) const
+{
+  return next (sc) != nullptr;
+}
+
 struct op_origin::state
 {
   stack::uptr m_stk;
@@ -88,6 +101,12 @@ op_origin::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_origin::state_reset (scon &sc) const
+{
+  sc.get <state> (m_ll).m_stk = nullptr;
+}
+
 void
 op_origin::set_next (scon &sc, stack::uptr s) const
 {
@@ -97,6 +116,15 @@ op_origin::set_next (scon &sc, stack::uptr s) const
   st.m_stk = std::move (s);
 }
 
+void
+op_origin::set_next (scon &sc, stack const &stk, size_t need) const
+{
+  if (need == whole_stack || need >= stk.size ())
+    set_next (sc, std::make_unique <stack> (stk));
+  else
+    set_next (sc, std::make_unique <stack> (stk, need));
+}
+
 stack::uptr
 op_origin::next (scon &sc) const
 {
@@ -289,6 +317,15 @@ op_format::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_format::state_reset (scon &sc) const
+{
+  sc.reset <state> (m_ll);
+  m_stringer->state_des (sc);
+  m_stringer->state_con (sc);
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_format::next (scon &sc) const
 {
@@ -423,6 +460,20 @@ op_merge::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_merge::state_reset (scon &sc) const
+{
+  state &st = sc.get <state> (m_ll);
+  for (auto &ptr: st.m_file)
+    ptr = nullptr;
+  st.m_idx = 0;
+  st.m_done = false;
+
+  for (auto const &branch: m_ops)
+    branch->state_reset (sc);
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_merge::next (scon &sc) const
 {
@@ -493,6 +544,15 @@ op_or::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_or::state_reset (scon &sc) const
+{
+  sc.reset <state> (m_ll, m_branches);
+  for (auto const &branch: m_branches)
+    branch.second->state_reset (sc);
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_or::next (scon &sc) const
 {
@@ -554,20 +614,26 @@ op_capture::state_des (scon &sc) const
   m_op->state_des (sc);
 }
 
+void
+op_capture::state_reset (scon &sc) const
+{
+  m_op->state_reset (sc);
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_capture::next (scon &sc) const
 {
   if (auto stk = m_upstream->next (sc))
     {
-      m_origin->set_next (sc, std::make_unique <stack> (*stk));
+      m_origin->set_next (sc, *stk, m_need);
 
       value_seq::seq_t vv;
       while (auto stk2 = m_op->next (sc))
 	vv.push_back (stk2->pop ());
 
       stk->push (std::make_unique <value_seq> (std::move (vv), 0));
-      m_op->state_des (sc);
-      m_op->state_con (sc);
+      m_op->state_reset (sc);
       return stk;
     }
 
@@ -583,20 +649,82 @@ op_capture::name () const
 
 namespace
 {
-  struct deref_less
+  // A set of stacks seen by a transitive closure.  Stacks are hashed
+  // and kept in an open-addressing table, full comparison is only
+  // done for stacks whose hashes match.
+  class stack_set
   {
-    template <class T>
+    struct slot
+    {
+      size_t hash;
+      std::shared_ptr <stack> stk;
+    };
+
+    std::vector <slot> m_slots;
+    size_t m_size;
+
+    slot &
+    find_slot (size_t hash, stack const &stk)
+    {
+      size_t mask = m_slots.size () - 1;
+      for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+	  slot &s = m_slots[i];
+	  if (s.stk == nullptr
+	      || (s.hash == hash && *s.stk == stk))
+	    return s;
+	}
+    }
+
+    void
+    grow ()
+    {
+      std::vector <slot> old (m_slots.size () * 2);
+      old.swap (m_slots);
+      for (auto &s: old)
+	if (s.stk != nullptr)
+	  find_slot (s.hash, *s.stk) = std::move (s);
+    }
+
+  public:
+    stack_set ()
+      : m_slots (16)
+      , m_size {0}
+    {}
+
+    // Returns true if STK wasn't in the set yet.
     bool
-    operator() (T const &a, T const &b)
+    insert (std::shared_ptr <stack> stk)
     {
-      return *a < *b;
+      if (2 * (m_size + 1) > m_slots.size ())
+	grow ();
+
+      size_t hash = stk->hash ();
+      slot &s = find_slot (hash, *stk);
+      if (s.stk != nullptr)
+	return false;
+
+      s.hash = hash;
+      s.stk = std::move (stk);
+      ++m_size;
+      return true;
+    }
+
+    void
+    clear ()
+    {
+      if (m_size == 0)
+	return;
+      for (auto &s: m_slots)
+	s.stk = nullptr;
+      m_size = 0;
     }
   };
 }
 
 struct op_tr_closure::state
 {
-  std::set <std::shared_ptr <stack>, deref_less> m_seen;
+  stack_set m_seen;
   std::vector <std::shared_ptr <stack> > m_stks;
   bool m_op_drained;
 
@@ -635,10 +763,23 @@ op_tr_closure::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_tr_closure::state_reset (scon &sc) const
+{
+  // Keep the memory that the seen-cache has allocated.
+  state &st = sc.get <state> (m_ll);
+  st.m_seen.clear ();
+  st.m_stks.clear ();
+  st.m_op_drained = true;
+
+  m_op->state_reset (sc);
+  inner_op::state_reset (sc);
+}
+
 std::unique_ptr <stack>
 op_tr_closure::state::yield_and_cache (std::shared_ptr <stack> stk)
 {
-  if (m_seen.insert (stk).second)
+  if (m_seen.insert (stk))
     {
       m_stks.push_back (stk);
       return std::make_unique <stack> (*stk);
@@ -732,11 +873,13 @@ op_subx::op_subx (layout &l,
 		  std::shared_ptr <op> upstream,
 		  std::shared_ptr <op_origin> origin,
 		  std::shared_ptr <op> op,
-		  size_t keep)
+		  size_t keep,
+		  size_t need)
   : inner_op {upstream}
   , m_origin {origin}
   , m_op {op}
   , m_keep {keep}
+  , m_need {need}
   , m_ll {l.reserve <state> ()}
 {}
 
@@ -756,6 +899,14 @@ op_subx::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_subx::state_reset (scon &sc) const
+{
+  sc.get <state> (m_ll).m_stk = nullptr;
+  m_op->state_reset (sc);
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_subx::next (scon &sc) const
 {
@@ -765,7 +916,7 @@ op_subx::next (scon &sc) const
     {
       while (st.m_stk == nullptr)
 	if (st.m_stk = m_upstream->next (sc))
-	  m_origin->set_next (sc, std::make_unique <stack> (*st.m_stk));
+	  m_origin->set_next (sc, *st.m_stk, m_need);
 	else
 	  return nullptr;
 
@@ -814,7 +965,7 @@ op_f_debug::name () const
 
 struct op_bind::state
 {
-  std::unique_ptr <value> m_current;
+  shared_value m_current;
 };
 
 op_bind::op_bind (layout &l, std::shared_ptr <op> upstream)
@@ -844,23 +995,30 @@ op_bind::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_bind::state_reset (scon &sc) const
+{
+  sc.get <state> (m_ll).m_current.reset ();
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_bind::next (scon &sc) const
 {
   state &st = sc.get <state> (m_ll);
   if (auto stk = m_upstream->next (sc))
     {
-      st.m_current = stk->pop ();
+      st.m_current = stk->pop_shared ();
       return stk;
     }
   return nullptr;
 }
 
-std::unique_ptr <value>
+shared_value const &
 op_bind::current (scon &sc) const
 {
   state &st = sc.get <state> (m_ll);
-  return st.m_current->clone ();
+  return st.m_current;
 }
 
 
@@ -911,7 +1069,7 @@ op_upread::next (scon &sc) const
   auto &rdv = sc.get <op_apply::rendezvous> (m_rdv_ll);
   if (auto stk = m_upstream->next (sc))
     {
-      stk->push (rdv.closure.get_env (m_id).clone ());
+      stk->push (rdv.closure.get_env (m_id));
       return stk;
     }
   else
@@ -938,9 +1096,9 @@ op_lex_closure::next (scon &sc) const
   if (auto stk = m_upstream->next (sc))
     {
       // Fetch actual values of the referenced environment bindings.
-      std::vector <std::unique_ptr <value>> env;
+      std::vector <shared_value> env;
       for (size_t i = 0; i < m_n_upvalues; ++i)
-	env.push_back (std::move (stk->pop ()));
+	env.push_back (stk->pop_shared ());
 
       stk->push (std::make_unique <value_closure> (m_op_layout, m_rdv_ll,
 						   m_origin, m_op,
@@ -995,6 +1153,13 @@ op_ifelse::state_des (scon &sc) const
   sc.des <state> (m_ll);
 }
 
+void
+op_ifelse::state_reset (scon &sc) const
+{
+  sc.get <state> (m_ll).m_sg = nonstd::nullopt;
+  inner_op::state_reset (sc);
+}
+
 stack::uptr
 op_ifelse::next (scon &sc) const
 {
@@ -1110,8 +1275,8 @@ pred_result
 pred_subx_any::result (scon &sc, stack &stk) const
 {
   scon_guard sg {sc, *m_op};
-  m_origin->set_next (sc, std::make_unique <stack> (stk));
-  if (m_op->next (sc) != nullptr)
+  m_origin->set_next (sc, stk, m_need);
+  if (m_op->probe (sc))
     return pred_result::yes;
   else
     return pred_result::no;
@@ -53,8 +53,21 @@ public:
   virtual void state_con (scon &sc) const = 0;
   virtual void state_des (scon &sc) const = 0;
 
+  // Bring state of this op back to what state_con leaves.  This is
+  // used when a sub-expression is run anew for each incoming stack.
+  // The default destroys and constructs the state again, ops that can
+  // clear their state in place, keeping whatever memory they have
+  // allocated, override this.
+  virtual void state_reset (scon &sc) const;
+
   // Produce next value.
   virtual stack::uptr next (scon &sc) const = 0;
+
+  // Like next, but only tell whether there was a stack to produce.
+  // pred_subx_any only cares about that, and ops that can find it
+  // out without building the stack override this.  Afterwards, the
+  // state is only good for state_des or state_reset.
+  virtual bool probe (scon &sc) const;
 };
 
 template <class RT>
@@ -112,6 +125,10 @@ public:
 
   void state_des (scon &sc) const override
   { m_upstream->state_des (sc); }
+
+  // Ops that keep state of their own need to override this as well.
+  void state_reset (scon &sc) const override
+  { m_upstream->state_reset (sc); }
 };
 
 // Class pred is for holding predicates.  These don't alter the
@@ -137,6 +154,10 @@ public:
 //
 // Several operations use origin to handle sub-expressions
 // (e.g. op_capture and pred_subx_any).
+//
+// When it's known that a sub-expression only looks at a couple
+// values near TOS, the origin is only given those.  That way the
+// rest of the stack doesn't need to be copied.
 class op_origin
   : public op
 {
@@ -149,9 +170,15 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 
   void set_next (scon &sc, stack::uptr s) const;
+
+  // Send down a copy of the NEED values near TOS of STK, or of the
+  // whole STK if NEED is whole_stack.
+  static size_t const whole_stack = (size_t) -1;
+  void set_next (scon &sc, stack const &stk, size_t need) const;
 };
 
 struct stub_op
@@ -290,6 +317,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -377,6 +405,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -394,6 +423,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 
   void
@@ -409,19 +439,24 @@ class op_capture
 {
   std::shared_ptr <op_origin> m_origin;
   std::shared_ptr <op> m_op;
+  size_t m_need;
 
 public:
+  // NEED is how many values near TOS OP looks at, see op_origin.
   op_capture (std::shared_ptr <op> upstream,
 	      std::shared_ptr <op_origin> origin,
-	      std::shared_ptr <op> op)
+	      std::shared_ptr <op> op,
+	      size_t need = op_origin::whole_stack)
     : inner_op {upstream}
     , m_origin {origin}
     , m_op {op}
+    , m_need {need}
   {}
 
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -456,6 +491,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -467,18 +503,22 @@ class op_subx
   std::shared_ptr <op_origin> m_origin;
   std::shared_ptr <op> m_op;
   size_t m_keep;
+  size_t m_need;
   layout::loc m_ll;
 
 public:
+  // NEED is how many values near TOS OP looks at, see op_origin.
   op_subx (layout &l,
 	   std::shared_ptr <op> upstream,
 	   std::shared_ptr <op_origin> origin,
 	   std::shared_ptr <op> op,
-	   size_t keep);
+	   size_t keep,
+	   size_t need = op_origin::whole_stack);
 
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -504,9 +544,11 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 
-  std::unique_ptr <value> current (scon &sc) const;
+  // The bound value.  op_read pushes it without cloning.
+  shared_value const &current (scon &sc) const;
 };
 
 class op_read
@@ -583,6 +625,7 @@ public:
   std::string name () const override;
   void state_con (scon &sc) const override;
   void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
   stack::uptr next (scon &sc) const override;
 };
 
@@ -654,12 +697,16 @@ class pred_subx_any
 {
   std::shared_ptr <op> m_op;
   std::shared_ptr <op_origin> m_origin;
+  size_t m_need;
 
 public:
+  // NEED is how many values near TOS OP looks at, see op_origin.
   pred_subx_any (std::shared_ptr <op> op,
-		 std::shared_ptr <op_origin> origin)
+		 std::shared_ptr <op_origin> origin,
+		 size_t need = op_origin::whole_stack)
     : m_op {op}
     , m_origin {origin}
+    , m_need {need}
   {}
 
   pred_result result (scon &sc, stack &stk) const override;
@@ -164,6 +164,13 @@ public:
 
   virtual std::shared_ptr <overloaded_builtin>
   create_merged (std::shared_ptr <overload_tab> tab) const = 0;
+
+  // The overload table that build_exec_followed builds from, given
+  // builtins NEXT that follow this one.  The default is the table that
+  // this builtin was created with.
+  virtual std::shared_ptr <overload_tab>
+  get_overload_tab_followed (std::vector <builtin const *> const &next) const
+  { return m_ovl_tab; }
 };
 
 // Base class for overloaded operation builtins.
@@ -485,6 +492,14 @@ class op_yielding_overload
     return operate (std::move (std::get <I> (args))...);
   }
 
+  template <size_t... I>
+  bool
+  call_exists (std::index_sequence <I...>,
+	       std::tuple <std::unique_ptr <VT>...> args) const
+  {
+    return exists (std::move (std::get <I> (args))...);
+  }
+
   struct state
   {
     stack::uptr m_stk;
@@ -513,6 +528,15 @@ public:
     sc.des <state> (m_ll);
   }
 
+  void
+  state_reset (scon &sc) const override final
+  {
+    state &st = sc.get <state> (m_ll);
+    st.m_prod = nullptr;
+    st.m_stk = nullptr;
+    m_upstream->state_reset (sc);
+  }
+
   stack::uptr
   next (scon &sc) const override final
   {
@@ -543,9 +567,36 @@ public:
       }
   }
 
+  // Only tell whether something would be yielded, without building
+  // the stack.  This defers to exists for each incoming stack.
+  bool
+  probe (scon &sc) const override final
+  {
+    state &st = sc.get <state> (m_ll);
+    if (st.m_prod != nullptr)
+      return next (sc) != nullptr;
+
+    while (auto stk = this->m_upstream->next (sc))
+      if (call_exists
+		(std::index_sequence_for <VT...> {},
+		 op_overload_impl <VT...>::template collect <0, VT...> (*stk)))
+	return true;
+
+    return false;
+  }
+
   virtual std::unique_ptr <value_producer <RT>>
 	operate (std::unique_ptr <VT>... vals) const = 0;
 
+  // Whether operate would produce any values.  Overloads that can
+  // tell without producing the first value override this.
+  virtual bool
+  exists (std::unique_ptr <VT>... vals) const
+  {
+    auto prod = operate (std::move (vals)...);
+    return prod != nullptr && prod->next () != nullptr;
+  }
+
   static builtin_protomap
   protomap ()
   {
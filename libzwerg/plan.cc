@@ -0,0 +1,156 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <cassert>
+#include <chrono>
+#include <ostream>
+
+#include "flag_saver.hh"
+#include "plan.hh"
+#include "scon.hh"
+
+struct op_explain::state
+{
+  uint64_t m_calls;
+  uint64_t m_yields;
+  uint64_t m_nsecs;
+};
+
+op_explain::op_explain (layout &l, std::shared_ptr <op> upstream)
+  : inner_op {upstream}
+  , m_ll {l.reserve <state> ()}
+  , m_calls {0}
+  , m_yields {0}
+  , m_nsecs {0}
+{}
+
+std::string
+op_explain::name () const
+{
+  return m_upstream->name ();
+}
+
+void
+op_explain::state_con (scon &sc) const
+{
+  sc.con <state> (m_ll);
+  inner_op::state_con (sc);
+}
+
+void
+op_explain::state_des (scon &sc) const
+{
+  inner_op::state_des (sc);
+
+  state &st = sc.get <state> (m_ll);
+  m_calls += st.m_calls;
+  m_yields += st.m_yields;
+  m_nsecs += st.m_nsecs;
+  sc.des <state> (m_ll);
+}
+
+void
+op_explain::state_reset (scon &sc) const
+{
+  // Counts carry over, they are only added to the totals when the
+  // state is destroyed.
+  inner_op::state_reset (sc);
+}
+
+stack::uptr
+op_explain::next (scon &sc) const
+{
+  using clock = std::chrono::steady_clock;
+  state &st = sc.get <state> (m_ll);
+
+  auto start = clock::now ();
+  auto stk = m_upstream->next (sc);
+  st.m_nsecs += std::chrono::duration_cast <std::chrono::nanoseconds>
+    (clock::now () - start).count ();
+
+  ++st.m_calls;
+  if (stk != nullptr)
+    ++st.m_yields;
+  return stk;
+}
+
+
+size_t
+query_plan::open ()
+{
+  m_entries.push_back ({m_depth++, nullptr, nullptr});
+  return m_entries.size () - 1;
+}
+
+std::shared_ptr <op>
+query_plan::close (size_t idx, layout &l, std::shared_ptr <op> upstream,
+		   std::shared_ptr <op> op)
+{
+  assert (m_depth > 0);
+  --m_depth;
+
+  // Nodes that don't build anything don't show up in the plan.
+  if (op == upstream)
+    return op;
+
+  auto probe = std::make_shared <op_explain> (l, op);
+  m_entries[idx].m_upstream = upstream.get ();
+  m_entries[idx].m_probe = probe;
+  return probe;
+}
+
+void
+query_plan::dump (std::ostream &o, bool analyze) const
+{
+  for (auto const &e: m_entries)
+    if (e.m_probe != nullptr)
+      {
+	o << std::string (2 * e.m_depth, ' ') << e.m_probe->name ();
+	if (analyze)
+	  {
+	    o << "  (";
+
+	    // Stacks that got in are those that the upstream op
+	    // yielded, if it is in the plan.  Origins aren't.
+	    for (auto const &f: m_entries)
+	      if (f.m_probe.get () == e.m_upstream)
+		{
+		  o << "in=" << f.m_probe->yields () << " ";
+		  break;
+		}
+
+	    ios_flag_saver s {o};
+	    auto prec = o.precision (3);
+	    o << "out=" << e.m_probe->yields ()
+	      << " next=" << e.m_probe->calls ()
+	      << " time=" << std::fixed << e.m_probe->nsecs () / 1e6 << "ms)";
+	    o.precision (prec);
+	  }
+	o << "\n";
+      }
+}
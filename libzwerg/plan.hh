@@ -0,0 +1,111 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include "op.hh"
+
+// An op that passes stacks from upstream along unchanged, but counts
+// them, and measures time that it takes to get them.  query_plan
+// puts one after each op of the query that it describes.
+//
+// Counts are kept in the scon while the op runs, and are added to
+// the totals when the state is destroyed.  Thus ops don't contend
+// with each other when the query runs on several threads.
+class op_explain
+  : public inner_op
+{
+  struct state;
+  layout::loc m_ll;
+
+  mutable std::atomic <uint64_t> m_calls;
+  mutable std::atomic <uint64_t> m_yields;
+  mutable std::atomic <uint64_t> m_nsecs;
+
+public:
+  op_explain (layout &l, std::shared_ptr <op> upstream);
+
+  // Number of times next was called, and how many of those calls
+  // yielded a stack.
+  uint64_t calls () const { return m_calls; }
+  uint64_t yields () const { return m_yields; }
+
+  // Time spent in upstream ops, including ops further up.
+  uint64_t nsecs () const { return m_nsecs; }
+
+  std::string name () const override;
+  void state_con (scon &sc) const override;
+  void state_des (scon &sc) const override;
+  void state_reset (scon &sc) const override;
+  stack::uptr next (scon &sc) const override;
+};
+
+// Ops that a query is built of, in the order that stacks flow
+// through them.  Ops that an op runs sub-expressions through are
+// nested in it.
+class query_plan
+{
+  struct entry
+  {
+    unsigned m_depth;
+    op const *m_upstream;
+    std::shared_ptr <op_explain> m_probe;
+  };
+
+  std::vector <entry> m_entries;
+  unsigned m_depth;
+
+public:
+  query_plan ()
+    : m_depth {0}
+  {}
+
+  // Note that an op is about to be built.  Ops that are built before
+  // the matching close are nested in it.  Returns a handle to pass
+  // to close.
+  size_t open ();
+
+  // Register OP that was built on top of UPSTREAM for handle IDX.
+  // Returns the op that should be used in place of OP.
+  std::shared_ptr <op> close (size_t idx, layout &l,
+			      std::shared_ptr <op> upstream,
+			      std::shared_ptr <op> op);
+
+  // Write a line for each op to O.  If ANALYZE, include numbers of
+  // stacks that got to and out of each op, and time spent.
+  void dump (std::ostream &o, bool analyze) const;
+};
+
+#endif /* _PLAN_H_ */
@@ -0,0 +1,128 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <new>
+
+#include "pool.hh"
+
+namespace
+{
+  size_t const granule = 16;
+  size_t const nclasses = 16;
+
+  // Limit on the number of blocks kept in each free list.  Blocks
+  // freed beyond that are returned to the global operator delete.
+  unsigned const max_cached = 4096;
+
+  struct block
+  {
+    block *next;
+  };
+
+  // This is kept trivially destructible, so that it stays usable
+  // even while other thread-local objects are being destroyed.
+  struct free_lists
+  {
+    block *heads[nclasses];
+    unsigned counts[nclasses];
+    bool registered;
+    bool dead;
+  };
+
+  thread_local free_lists g_lists;
+
+  // Releases the cached blocks when the thread exits.
+  struct reaper
+  {
+    ~reaper ()
+    {
+      for (size_t i = 0; i < nclasses; ++i)
+	while (block *b = g_lists.heads[i])
+	  {
+	    g_lists.heads[i] = b->next;
+	    ::operator delete (b);
+	  }
+      g_lists.dead = true;
+    }
+
+    void
+    touch ()
+    {}
+  };
+
+  thread_local reaper g_reaper;
+
+  size_t
+  size_class (size_t size)
+  {
+    return (size + granule - 1) / granule - 1;
+  }
+}
+
+void *
+pool_allocate (size_t size)
+{
+  size_t cls = size_class (size);
+  if (size == 0 || cls >= nclasses)
+    return ::operator new (size);
+
+  if (block *b = g_lists.heads[cls])
+    {
+      g_lists.heads[cls] = b->next;
+      --g_lists.counts[cls];
+      return b;
+    }
+
+  return ::operator new ((cls + 1) * granule);
+}
+
+void
+pool_deallocate (void *ptr, size_t size)
+{
+  if (ptr == nullptr)
+    return;
+
+  size_t cls = size_class (size);
+  if (size == 0 || cls >= nclasses || g_lists.dead
+      || g_lists.counts[cls] >= max_cached)
+    {
+      ::operator delete (ptr);
+      return;
+    }
+
+  if (! g_lists.registered)
+    {
+      g_reaper.touch ();
+      g_lists.registered = true;
+    }
+
+  block *b = static_cast <block *> (ptr);
+  b->next = g_lists.heads[cls];
+  g_lists.heads[cls] = b;
+  ++g_lists.counts[cls];
+}
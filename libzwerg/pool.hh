@@ -0,0 +1,59 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <cstddef>
+
+// Stacks and values are allocated and freed at a high rate as
+// queries run.  Classes that inherit from pool_allocated get their
+// memory from per-thread free lists of small blocks, sorted by size.
+// A freed block is handed out again by the next allocation of the
+// same size class, on whichever thread frees it.  Objects larger than
+// the largest size class go straight to the global operator new.
+
+void *pool_allocate (size_t size);
+void pool_deallocate (void *ptr, size_t size);
+
+struct pool_allocated
+{
+  static void *
+  operator new (size_t size)
+  {
+    return pool_allocate (size);
+  }
+
+  static void
+  operator delete (void *ptr, size_t size)
+  {
+    pool_deallocate (ptr, size);
+  }
+};
+
+#endif /* _POOL_H_ */
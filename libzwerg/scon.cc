@@ -29,13 +29,46 @@
 #include "scon.hh"
 #include "op.hh"
 
+namespace
+{
+  thread_local std::vector <std::vector <uint8_t>> free_bufs;
+
+  // Only keep this many buffers around.  Nested closure applications
+  // each hold one buffer, so this covers fairly deep recursion.
+  size_t const max_free_bufs = 64;
+}
+
+scon::scon ()
+{
+  if (! free_bufs.empty ())
+    {
+      m_buf = std::move (free_bufs.back ());
+      free_bufs.pop_back ();
+    }
+}
+
 scon::scon (layout const &l)
+  : scon {}
+{
+  renew (l);
+}
+
+scon::~scon ()
+{
+  if (m_buf.capacity () > 0 && free_bufs.size () < max_free_bufs)
+    free_bufs.push_back (std::move (m_buf));
+}
+
+void
+scon::renew (layout const &l)
+{
   // 85 is 0b1010101, a pattern that's very unlikely to be valid data. If
   // op::state_con is not called, this is likely to cause a loud & early
   // failure. op_origin relies on this poisoning to detect that the state_con
-  // chain is interrupted.
-  : m_buf (l.size (), 85)
-{}
+  // chain is interrupted.  A buffer that is big enough already is
+  // reused.
+  m_buf.assign (l.size (), 85);
+}
 
 scon_guard::scon_guard (scon_guard &&mv)
   : m_sc {mv.m_sc}
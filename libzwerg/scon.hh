@@ -46,7 +46,16 @@ class scon
   }
 
 public:
-  scon (layout const &l);
+  // Buffers are taken from, and returned to, a per-thread free list.
+  // Closures are applied over and over, each application with a
+  // fresh scon, and this saves an allocation for each of them.
+  scon ();
+  explicit scon (layout const &l);
+  scon (scon const &that) = delete;
+  ~scon ();
+
+  // Drop the current contents and size the buffer for layout L.
+  void renew (layout const &l);
 
   template <class State>
   State &
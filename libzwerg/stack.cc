@@ -31,17 +31,33 @@
 #include "value-closure.hh"
 
 stack::stack (stack const &that)
-  : m_profile {that.m_profile}
+  : m_checked {that.m_checked}
 {
-  for (auto const &v: that.m_values)
-    m_values.push_back (v->clone ());
+  m_values.reserve (that.m_values.size ());
+  for (auto v: that.m_values)
+    m_values.push_back (share (v));
+}
+
+stack::stack (stack const &that, size_t n)
+  : m_checked {that.m_checked}
+{
+  assert (n <= that.m_values.size ());
+  m_values.reserve (n);
+  for (auto it = that.m_values.end () - n; it != that.m_values.end (); ++it)
+    m_values.push_back (share (*it));
+}
+
+stack::~stack ()
+{
+  for (auto v: m_values)
+    release (v);
 }
 
 namespace
 {
   int
-  compare_stack (std::vector <std::unique_ptr <value> > const &a,
-	       std::vector <std::unique_ptr <value> > const &b)
+  compare_stack (std::vector <value *> const &a,
+		 std::vector <value *> const &b)
   {
     if (a.size () < b.size ())
       return -1;
@@ -111,3 +127,12 @@ stack::operator== (stack const &that) const
 {
   return compare_stack (m_values, that.m_values) == 0;
 }
+
+size_t
+stack::hash () const
+{
+  size_t ret = m_values.size ();
+  for (auto v: m_values)
+    ret = hash_combine (ret, v != nullptr ? v->hash () : 0);
+  return ret;
+}
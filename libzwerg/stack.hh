@@ -30,31 +30,155 @@
 #ifndef _STK_H_
 #define _STK_H_
 
+#include <cassert>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
+#include "pool.hh"
 #include "value.hh"
 #include "selector.hh"
 
 enum var_id: unsigned {};
 
+// A reference to a value held outside of stacks, e.g. by a variable
+// binding.  The value is shared the same way stack copies share
+// values: copying the reference, or pushing it on a stack, doesn't
+// clone the value, and a stack that pops it gets a clone unless it
+// held the last reference.  The value must not be modified.
+class shared_value
+{
+  friend class stack;
+  value *m_vp;
+
+  // Take over a reference that the caller already holds.
+  explicit shared_value (value *vp)
+    : m_vp {vp}
+  {}
+
+public:
+  shared_value ()
+    : m_vp {nullptr}
+  {}
+
+  explicit shared_value (std::unique_ptr <value> vp)
+    : m_vp {vp.release ()}
+  {}
+
+  shared_value (shared_value const &that)
+    : m_vp {that.m_vp}
+  {
+    if (m_vp != nullptr)
+      ++m_vp->m_shares;
+  }
+
+  shared_value (shared_value &&that)
+    : m_vp {that.m_vp}
+  {
+    that.m_vp = nullptr;
+  }
+
+  shared_value &
+  operator= (shared_value that)
+  {
+    std::swap (m_vp, that.m_vp);
+    return *this;
+  }
+
+  ~shared_value ()
+  {
+    reset ();
+  }
+
+  void
+  reset ()
+  {
+    if (m_vp != nullptr)
+      {
+	if (m_vp->m_shares == 0)
+	  delete m_vp;
+	else
+	  --m_vp->m_shares;
+	m_vp = nullptr;
+      }
+  }
+
+  value &operator* () const { return *m_vp; }
+  value *operator-> () const { return m_vp; }
+  value *get () const { return m_vp; }
+
+  bool
+  operator< (shared_value const &that) const
+  {
+    return m_vp < that.m_vp;
+  }
+};
+
 // Stack is a container type that's used for maintaining stacks of dwgrep
 // values.
+//
+// Stacks are copied whenever the computation forks (alternation,
+// closures, iteration etc.).  To make that cheap, copying a stack
+// doesn't clone the values, but shares them between both copies.
+// A shared value is only cloned when it's popped, because that's when
+// the caller gets to modify it.  Values obtained through the
+// accessors (top, get and friends) may be shared with other stacks
+// and must not be modified.
 class stack
+  : public pool_allocated
 {
-  std::vector <std::unique_ptr <value>> m_values;
-  selector::sel_t m_profile;
+  std::vector <value *> m_values;
+
+  // Whether need() checks stack depth.  This is turned off for stacks
+  // fed to queries that were proven never to underrun (see
+  // stack_profile).  Copies inherit the setting.
+  bool m_checked;
+
+  static void
+  release (value *vp)
+  {
+    if (vp->m_shares == 0)
+      delete vp;
+    else
+      --vp->m_shares;
+  }
+
+  static value *
+  share (value *vp)
+  {
+    ++vp->m_shares;
+    return vp;
+  }
+
+  value *
+  slot (unsigned depth) const
+  {
+    return *(m_values.rbegin () + depth);
+  }
 
 public:
   typedef std::unique_ptr <stack> uptr;
 
   stack ()
-    : m_profile {0}
+    : m_checked {true}
   {}
 
   stack (stack const &other);
-  stack (stack &&other) = default;
+
+  // Copy only the N values near TOS of OTHER.
+  stack (stack const &other, size_t n);
+
+  stack (stack &&other)
+    : m_values {std::move (other.m_values)}
+    , m_checked {other.m_checked}
+  {
+    other.m_values.clear ();
+  }
+
+  stack &operator= (stack const &other) = delete;
+
+  ~stack ();
 
   size_t
   size () const
@@ -62,53 +186,92 @@ public:
     return m_values.size ();
   }
 
+  // Types of values near TOS, as used by selectors.  This is only
+  // needed when an overloaded word dispatches at runtime, which most
+  // don't (see stack_profile), so it is computed on demand rather
+  // than kept up to date as values are pushed and popped.
   selector::sel_t
   profile () const
   {
-    return m_profile;
+    selector::sel_t ret = 0;
+    for (unsigned d = 0; d < selector::W && d < m_values.size (); ++d)
+      ret |= ((selector::sel_t) slot (d)->get_type ().code ()) << (d * 8);
+    return ret;
   }
 
   void
   push (std::unique_ptr <value> vp)
   {
-    m_profile <<= 8;
-    m_profile |= vp->get_type ().code ();
-    m_values.push_back (std::move (vp));
+    m_values.push_back (vp.get ());
+    vp.release ();
+  }
+
+  // Push another reference to SV's value.
+  void
+  push (shared_value const &sv)
+  {
+    assert (sv.get () != nullptr);
+    m_values.push_back (share (sv.get ()));
+  }
+
+  // Push another reference to the value at DEPTH.
+  void
+  dup (unsigned depth)
+  {
+    need (depth + 1);
+    value *vp = slot (depth);
+    m_values.push_back (share (vp));
+  }
+
+  void
+  set_checked (bool checked)
+  {
+    m_checked = checked;
   }
 
   void
   need (unsigned depth) const
   {
-    if (depth > m_values.size ())
+    if (m_checked && depth > m_values.size ())
       throw std::runtime_error ("stack overflow");
+    assert (depth <= m_values.size ());
   }
 
   std::unique_ptr <value>
   pop ()
   {
     need (1);
-    auto ret = std::move (m_values.back ());
+    value *vp = m_values.back ();
     m_values.pop_back ();
-    m_profile >>= 8;
-    if (m_values.size () >= selector::W)
+    std::unique_ptr <value> ret;
+    if (vp->m_shares == 0)
+      ret.reset (vp);
+    else
       {
-	auto code = get (selector::W - 1).get_type ().code ();
-	m_profile |= ((selector::sel_t) code) << (8 * (selector::W - 1));
+	ret = vp->clone ();
+	--vp->m_shares;
       }
     return ret;
   }
 
+  // Like pop, but hand over the reference instead of cloning a
+  // shared value.
+  shared_value
+  pop_shared ()
+  {
+    need (1);
+    value *vp = m_values.back ();
+    m_values.pop_back ();
+    return shared_value {vp};
+  }
+
   void
   drop (unsigned n)
   {
     need (n);
+    for (auto it = m_values.end () - n; it != m_values.end (); ++it)
+      release (*it);
     m_values.erase (m_values.end () - n, m_values.end ());
-    m_profile = 0;
-    for (unsigned d = 0; d < selector::W && d < m_values.size (); ++d)
-      {
-	auto code = get (d).get_type ().code ();
-	m_profile |= code << (d * 8);
-      }
   }
 
   template <class T>
@@ -124,21 +287,21 @@ public:
   top ()
   {
     need (1);
-    return *m_values.back ().get ();
+    return *m_values.back ();
   }
 
   value &
   get (unsigned depth)
   {
     need (depth + 1);
-    return *(m_values.rbegin () + depth)->get ();
+    return *slot (depth);
   }
 
   value const &
   get (unsigned depth) const
   {
     need (depth + 1);
-    return *(m_values.rbegin () + depth)->get ();
+    return *slot (depth);
   }
 
   template <class T>
@@ -159,6 +322,9 @@ public:
 
   bool operator< (stack const &that) const;
   bool operator== (stack const &that) const;
+
+  // Stacks that compare equal hash equal.
+  size_t hash () const;
 };
 
 #endif /* _STK_H_ */
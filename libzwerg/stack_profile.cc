@@ -0,0 +1,184 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+
+#include "stack_profile.hh"
+
+value_type const stack_profile::unknown_type {0};
+
+value_type
+stack_profile::at (size_t depth) const
+{
+  if (depth >= m_types.size ())
+    return unknown_type;
+  return m_types[m_types.size () - 1 - depth];
+}
+
+void
+stack_profile::push (value_type vt)
+{
+  if (m_types.size () == max_depth)
+    m_types.erase (m_types.begin ());
+
+  // Prototypes use the base value type for values of any type.
+  m_types.push_back (vt == value::vtype ? unknown_type : vt);
+  ++m_height;
+}
+
+void
+stack_profile::pop (size_t n)
+{
+  require (n);
+  m_types.resize (m_types.size () - std::min (n, m_types.size ()),
+		  unknown_type);
+  m_height -= n;
+}
+
+void
+stack_profile::require (size_t n)
+{
+  if (m_stats == nullptr || n == 0)
+    return;
+
+  if (! m_height_known)
+    m_stats->stack_need_known = false;
+  else if ((int) n > m_height)
+    m_stats->stack_need = std::max (m_stats->stack_need,
+				    (size_t) ((int) n - m_height));
+}
+
+void
+stack_profile::require_all ()
+{
+  if (m_stats != nullptr)
+    m_stats->stack_need_known = false;
+}
+
+stack_profile
+stack_profile::rebase (build_stats &stats) const
+{
+  stack_profile ret = *this;
+  ret.m_height = 0;
+  ret.m_height_known = true;
+  ret.m_stats = &stats;
+  return ret;
+}
+
+void
+stack_profile::clear ()
+{
+  m_types.clear ();
+  m_height_known = false;
+  if (m_stats != nullptr)
+    m_stats->stack_need_known = false;
+}
+
+void
+stack_profile::shuffle (size_t n, std::initializer_list <size_t> out)
+{
+  std::vector <value_type> types;
+  for (size_t depth: out)
+    types.push_back (at (depth));
+
+  pop (n);
+  for (auto vt: types)
+    push (vt);
+}
+
+bool
+stack_profile::may_match (selector const &sel) const
+{
+  auto types = sel.get_types ();
+  for (size_t i = 0; i < types.size (); ++i)
+    {
+      value_type vt = at (types.size () - 1 - i);
+      if (vt != unknown_type && vt != types[i])
+	return false;
+    }
+  return true;
+}
+
+bool
+stack_profile::must_match (selector const &sel) const
+{
+  auto types = sel.get_types ();
+  for (size_t i = 0; i < types.size (); ++i)
+    if (at (types.size () - 1 - i) != types[i])
+      return false;
+  return true;
+}
+
+void
+stack_profile::apply (builtin_prototype const &proto)
+{
+  if (std::get <1> (proto) == yield::pred)
+    {
+      require (std::get <0> (proto).size ());
+      return;
+    }
+
+  pop (std::get <0> (proto).size ());
+  for (auto const &vt: std::get <2> (proto))
+    push (vt);
+}
+
+void
+stack_profile::apply_depth (builtin_prototype const &proto)
+{
+  auto const &outs = std::get <2> (proto);
+  apply (builtin_prototype {std::get <0> (proto), std::get <1> (proto),
+			    std::vector <value_type> (outs.size (),
+						      unknown_type)});
+}
+
+void
+stack_profile::join_height (stack_profile const &that)
+{
+  if (! that.m_height_known || that.m_height != m_height)
+    m_height_known = false;
+}
+
+void
+stack_profile::join (stack_profile const &that)
+{
+  join_height (that);
+
+  size_t n = std::min (m_types.size (), that.m_types.size ());
+  std::vector <value_type> types;
+  for (size_t i = n; i > 0; --i)
+    {
+      value_type a = at (i - 1);
+      types.push_back (a == that.at (i - 1) ? a : unknown_type);
+    }
+
+  // Drop unknown slots at the bottom, those are implied.
+  auto it = std::find_if (types.begin (), types.end (),
+			  [] (value_type vt) { return vt != unknown_type; });
+  m_types.assign (it, types.end ());
+}
@@ -0,0 +1,182 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _STACK_PROFILE_H_
+#define _STACK_PROFILE_H_
+
+#include <initializer_list>
+#include <vector>
+
+#include "builtin.hh"
+#include "selector.hh"
+#include "value.hh"
+
+struct build_stats;
+class query_plan;
+
+// Types of values near TOS of stacks that flow through a given point
+// of a query, as far as they are known when the query is built.  This
+// is used to resolve overloaded words to a single overload up front,
+// instead of looking the overload up for each stack at runtime.
+//
+// The profile is conservative: a slot is known only if every stack
+// that can get to that point has a value of that type in it.  Slots
+// deeper than those tracked are unknown.
+//
+// Besides types, the profile tracks stack height relative to the
+// stack that the query starts with, for as long as it can be known.
+// Whenever the height drops below zero, the query needs that many
+// values on the input stack, and this is recorded in build_stats.
+class stack_profile
+{
+  // Back of the vector is TOS.  Unknown slots hold unknown_type.
+  std::vector <value_type> m_types;
+
+  int m_height;
+  bool m_height_known;
+
+  // Where to record stack need, or nullptr if this profile is not
+  // tracked.  Copies of the profile share the same stats.
+  build_stats *m_stats;
+
+  // Only this many slots near TOS are tracked.
+  static size_t const max_depth = 8;
+
+public:
+  static value_type const unknown_type;
+
+  // Create a profile where nothing is known.  Stack need is not
+  // tracked, e.g. because the stack that the code runs on is not the
+  // input stack of the query.
+  stack_profile ()
+    : m_height {0}
+    , m_height_known {false}
+    , m_stats {nullptr}
+  {}
+
+  // Create a profile of an empty input stack, recording stack need
+  // in STATS.
+  explicit stack_profile (build_stats &stats)
+    : m_height {0}
+    , m_height_known {true}
+    , m_stats {&stats}
+  {}
+
+  value_type at (size_t depth) const;
+  bool is_known (size_t depth) const
+  { return at (depth) != unknown_type; }
+
+  void push (value_type vt);
+  void pop (size_t n);
+
+  // Note that N values are needed on stack at this point.
+  void require (size_t n);
+
+  // Note that code at this point looks at the whole stack.
+  void require_all ();
+
+  // Return a profile with the same types, whose height is counted
+  // from this point, and whose stack need is recorded in STATS.
+  // This is for finding out what a sub-expression needs.
+  stack_profile rebase (build_stats &stats) const;
+
+  // Pop N values and push copies of those at each of depths OUT,
+  // counted before the pop.  The last depth ends up on TOS.
+  void shuffle (size_t n, std::initializer_list <size_t> out);
+
+  // Forget everything.  This is for code whose stack effect is not
+  // known, which may itself take any number of values from stack.
+  void clear ();
+
+  // Forget value types, but keep track of stack height.
+  void clear_types ()
+  { m_types.clear (); }
+
+  bool height_known () const
+  { return m_height_known; }
+
+  int height () const
+  { return m_height; }
+
+  // Whether stacks with this profile may match SEL.
+  bool may_match (selector const &sel) const;
+
+  // Whether all stacks with this profile match SEL.
+  bool must_match (selector const &sel) const;
+
+  // Apply the stack effect described by PROTO.
+  void apply (builtin_prototype const &proto);
+
+  // Like apply, but ignore the types in PROTO, only the number of
+  // values taken and left on stack matters.
+  void apply_depth (builtin_prototype const &proto);
+
+  // Merge THAT into this profile, for a point where stacks of either
+  // profile can show up.
+  void join (stack_profile const &that);
+
+  // Like join, but only merge stack heights.
+  void join_height (stack_profile const &that);
+
+  bool operator== (stack_profile const &that) const
+  { return m_types == that.m_types; }
+};
+
+// Statistics of resolution of overloaded words in a query, and of its
+// stack effect.  Also carries other information collected while a
+// query is built.
+struct build_stats
+{
+  // Number of uses of overloaded words that were resolved to a single
+  // overload when the query was built.
+  size_t pegged = 0;
+
+  // Number of uses that dispatch at runtime.
+  size_t dispatched = 0;
+
+  // Number of uses of words that were built differently because of
+  // the words that follow them, e.g. entry with a die_filter.
+  size_t followed = 0;
+
+  // Number of captures fused with the aggregating word that follows
+  // them, e.g. [A] length.
+  size_t fused = 0;
+
+  // How many values the query needs on the input stack.  If
+  // stack_need_known is false, values were taken from stack at a
+  // point where stack height was not known, and the query may need
+  // more than that.
+  size_t stack_need = 0;
+  bool stack_need_known = true;
+
+  // If not NULL, each op that the query is built of is registered
+  // here, so that the query can be explained.
+  query_plan *plan = nullptr;
+};
+
+#endif /* _STACK_PROFILE_H_ */
@@ -38,6 +38,8 @@
 #include "builtin.hh"
 #include "dwit.hh"
 #include "init.hh"
+#include "libzwerg-dw.h"
+#include "libzwerg.hh"
 #include "op.hh"
 #include "parser.hh"
 #include "stack.hh"
@@ -967,6 +969,80 @@ TEST_F (ZwTest, test_various)
     }
 }
 
+TEST_F (ZwTest, die_filter_installed)
+{
+  // Number of entry and child words that were given a die_filter by
+  // assertions right after them.  Comparisons are only recognized in
+  // simplified trees.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "entry ?TAG_subprogram"},
+	    {1, "entry !AT_declaration ?TAG_subprogram"},
+	    {1, "child ?TAG_member"},
+	    {2, "entry ?TAG_structure_type child !TAG_member"},
+	    {1, "entry ?(@AT_name == \"foo\")"},
+	    {1, "entry ?(\"foo\" == @AT_name)"},
+	    {1, "entry ?TAG_subprogram ?(@AT_name == \"foo\")"},
+	    {0, "entry ?(@AT_name != \"foo\")"},
+	    {0, "entry ?(@AT_byte_size == \"foo\")"},
+	    {0, "entry"},
+	    {0, "entry name"},
+	    {0, "entry ?root ?TAG_subprogram"},
+	})
+    {
+      auto stats = get_build_stats (*builtins, entry.second, true);
+      EXPECT_EQ (entry.first, stats.followed) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, optimize_hoists_die_preds)
+{
+  // child only yields DIE's, and ?TAG_* and ?AT_* can't fail on
+  // those, so they can go ahead of the sub-expression.  entry may
+  // also yield abbreviations, and what follows it keeps its order.
+  for (auto const &entry: std::vector <std::pair <std::string,
+						   std::string>> {
+	    {"child ?(child) ?TAG_subprogram",
+	     "child ?TAG_subprogram ?(child)"},
+	    {"child ?(child) !AT_name ?TAG_subprogram",
+	     "child !AT_name ?TAG_subprogram ?(child)"},
+	    {"entry ?(child) ?TAG_subprogram",
+	     "entry ?(child) ?TAG_subprogram"},
+	    {"elem ?(child) ?TAG_subprogram",
+	     "elem ?(child) ?TAG_subprogram"},
+	})
+    EXPECT_EQ (dump_tree (nullptr, entry.second),
+	       dump_tree (builtins.get (), entry.first)) << entry.first;
+}
+
+TEST_F (ZwTest, query_splits_over_units)
+{
+  std::unique_ptr <zw_vocabulary, zw_deleter> voc
+    {zw_vocabulary_init (zw_throw_on_error {})};
+  zw_vocabulary_add (voc.get (), zw_vocabulary_core (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+  zw_vocabulary_add (voc.get (), zw_vocabulary_dwarf (zw_throw_on_error {}),
+		     zw_throw_on_error {});
+
+  for (auto const &entry: std::vector <std::pair <bool, std::string>> {
+	    {true, "entry"},
+	    {true, "unit"},
+	    {true, "entry ?TAG_subprogram name"},
+	    {true, "unit root"},
+	    {false, "abbrev"},
+	    {false, "1 drop entry"},
+	    {false, "entry, unit"},
+	    {false, "entry let entry := unit;"},
+	})
+    {
+      std::unique_ptr <zw_query, zw_deleter> query
+	{zw_query_parse (voc.get (), entry.second.c_str (),
+			 zw_throw_on_error {})};
+      EXPECT_EQ (entry.first,
+		 zw_query_splits_over_units (voc.get (), query.get ()))
+	<< entry.second;
+    }
+}
+
 TEST_F (ZwTest, test_const_value_block)
 {
   test_pairs (*builtins, "const_value_block.o",
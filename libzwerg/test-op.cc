@@ -281,6 +281,27 @@ TEST_F (ZwTest, test_assert_subx)
     }
 }
 
+TEST_F (ZwTest, test_assert_subx_probe)
+{
+  // ?(...) only asks whether the sub-expression yields anything.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "[1, 2] ?(elem)"},
+	    {0, "[] ?(elem)"},
+	    {1, "[] !(elem)"},
+	    {2, "([], [1], [2, 3]) ?(elem)"},
+	    {1, "[[], [1]] ?(elem elem)"},
+	    {0, "[[], []] ?(elem elem)"},
+	    {1, "\"ab\" ?(elem \"b\" ?eq)"},
+	    {1, "[1] 2 ?(drop elem)"},
+	    {0, "[] 2 ?(drop elem)"},
+	})
+    {
+      auto stk = std::make_unique <stack> ();
+      auto yielded = run_query (*builtins, std::move (stk), entry.second);
+      EXPECT_EQ (entry.first, yielded.size ()) << entry.second;
+    }
+}
+
 TEST_F (ZwTest, test_assert_block)
 {
   for (auto const &entry: std::map <size_t, std::string> {
@@ -308,3 +329,263 @@ TEST_F (ZwTest, test_various)
       ASSERT_EQ (entry.first, yielded.size ());
     }
 }
+
+TEST_F (ZwTest, subexpr_trimmed_stack)
+{
+  // Sub-expressions run on a copy of only the values they need, and
+  // what they yield should be the same as with the whole stack.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "1 2 [drop] == [1]"},
+	    {1, "1 2 [swap] == [1]"},
+	    {1, "1 2 [3 add] == [5]"},
+	    {1, "1 2 3 [drop drop] length == 1"},
+	})
+    {
+      auto stk = std::make_unique <stack> ();
+      auto yielded = run_query (*builtins, std::move (stk), entry.second);
+      EXPECT_EQ (entry.first, yielded.size ()) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, stack_copy_shares_values)
+{
+  stack stk;
+  stk.push (std::make_unique <value_cst> (constant {7, &dec_constant_dom}, 0));
+  stk.dup (0);
+
+  stack copy {stk};
+  ASSERT_EQ (&stk.get (0), &copy.get (0));
+  ASSERT_EQ (&stk.get (0), &stk.get (1));
+
+  // Popping a shared value yields a private copy that can be modified
+  // without affecting the other stacks.
+  auto v = copy.pop ();
+  ASSERT_NE (&stk.get (0), v.get ());
+  v->set_pos (5);
+  ASSERT_EQ (0, stk.get (0).get_pos ());
+  ASSERT_EQ (0, copy.get (0).get_pos ());
+
+  stk.drop (2);
+  auto w = copy.pop ();
+  w->set_pos (3);
+  ASSERT_EQ (0, copy.size ());
+  ASSERT_EQ (0, stk.size ());
+}
+
+TEST_F (ZwTest, shared_value_pushes_share)
+{
+  shared_value sv {std::make_unique <value_cst>
+			(constant {7, &dec_constant_dom}, 0)};
+
+  stack stk;
+  stk.push (sv);
+  stk.push (sv);
+  ASSERT_EQ (sv.get (), &stk.get (0));
+  ASSERT_EQ (sv.get (), &stk.get (1));
+
+  // The binding keeps its value when the stack pops a copy and
+  // modifies it.
+  auto v = stk.pop ();
+  ASSERT_NE (sv.get (), v.get ());
+  v->set_pos (5);
+  ASSERT_EQ (0, sv->get_pos ());
+
+  // Handing the reference over doesn't clone.
+  auto sv2 = stk.pop_shared ();
+  ASSERT_EQ (sv.get (), sv2.get ());
+  sv.reset ();
+  ASSERT_EQ (0, sv2->get_pos ());
+
+  // Bound values survive being read and modified repeatedly.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "let A := [1]; A [2] add A [3] add "
+		"(|B C| (B == [1, 2]) (C == [1, 3]) (A == [1]))"},
+	    {1, "[1] (|A| {A [2] add} apply (A == [1]))"},
+	    {1, "[1] (|A| ({A} apply [2] add == [1, 2]) (A == [1]))"},
+	})
+    {
+      auto stk = std::make_unique <stack> ();
+      auto yielded = run_query (*builtins, std::move (stk), entry.second);
+      ASSERT_EQ (entry.first, yielded.size ()) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, test_closure_seen)
+{
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {5, "0 (1 add 5 mod)*"},
+	    {5, "0 (1 add 5 mod)+"},
+	    {3, "[] ([1] add ?(length 2 ?le))*"},
+	    {4, "\"\" (\"x\" add ?(length 3 ?le))*"},
+	    {2, "0 (drop ([0], 0xff0 0xff0 sub))*"},
+	})
+    {
+      auto stk = std::make_unique <stack> ();
+      auto yielded = run_query (*builtins, std::move (stk), entry.second);
+      ASSERT_EQ (entry.first, yielded.size ()) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, aggregate)
+{
+  // Aggregating words right after a capture are fused with it, the
+  // ones after a bound value are not.  Both should agree.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "[1, 2, 3] length == 3"},
+	    {1, "let S := [1, 2, 3]; S length == 3"},
+	    {1, "[] length == 0"},
+	    {2, "(1, 2) [3, 4] length == 2"},
+	    {1, "[(1, 2) (3, 4)] length == 4"},
+	    {1, "[1, 2, 3] sum == 6"},
+	    {1, "let S := [1, 2, 3]; S sum == 6"},
+	    {1, "[] sum == 0"},
+	    {0, "[1, \"x\"] sum"},
+	    {1, "[3, 1, 2] min == 1"},
+	    {1, "[3, 1, 2] max == 3"},
+	    {1, "let S := [3, 1, 2]; S max == 3"},
+	    {0, "[] min"},
+	    {1, "[1, 2, 1, 3, 2] distinct == [1, 2, 3]"},
+	    {1, "let S := [1, 2, 1, 3, 2]; S distinct == [1, 2, 3]"},
+	    {1, "[1, 2, 1, 3, 1] histogram == [[1, 3], [2, 1], [3, 1]]"},
+	    {1, "let S := [3, 1, 1]; S histogram == [[1, 2], [3, 1]]"},
+	})
+    {
+      auto stk = std::make_unique <stack> ();
+      auto yielded = run_query (*builtins, std::move (stk), entry.second);
+      ASSERT_EQ (entry.first, yielded.size ()) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, aggregate_fused)
+{
+  // Number of captures fused with the aggregating word after them.
+  for (auto const &entry: std::vector <std::pair <size_t, std::string>> {
+	    {1, "[1, 2, 3] length"},
+	    {1, "[1, 2, 3] sum"},
+	    {1, "[3, 1, 2] min"},
+	    {1, "[3, 1, 2] max"},
+	    {1, "[1, 2, 1] distinct"},
+	    {1, "[1, 2, 1] histogram"},
+	    {2, "[1] length [2] sum add"},
+	    {1, "(1, 2) [3, 4] length"},
+	    {2, "[[1] length] length"},
+	    {0, "let S := [1, 2, 3]; S length"},
+	    {0, "[1, 2, 3] elem"},
+	    {0, "[1, 2, 3]"},
+	    {0, "length"},
+	})
+    {
+      auto stats = get_build_stats (*builtins, entry.second, true);
+      EXPECT_EQ (entry.first, stats.fused) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, overloads_pegged)
+{
+  // Pairs of pegged and dispatched uses of overloaded words.
+  for (auto const &entry: std::vector <std::pair <std::pair <size_t, size_t>,
+						   std::string>> {
+	    {{1, 0}, "1 2 add"},
+	    {{2, 0}, "1 2 add 3 add"},
+	    {{1, 0}, "\"foo\" length"},
+	    {{1, 0}, "[1, 2] length"},
+	    {{1, 0}, "\"\" ?empty"},
+	    {{1, 1}, "1 [2] elem add"},
+	    {{2, 0}, "1 (2, 3) add 4 add"},
+	    {{0, 1}, "add"},
+	    {{0, 1}, "1 (2, \"x\") add"},
+	    {{0, 1}, "let A := 1; A A add"},
+	    {{1, 1}, "0 (1 add 5 mod)*"},
+	})
+    {
+      auto stats = get_build_stats (*builtins, entry.second);
+      EXPECT_EQ (entry.first.first, stats.pegged) << entry.second;
+      EXPECT_EQ (entry.first.second, stats.dispatched) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, stack_need)
+{
+  // Values needed on input stack, and whether that is known exactly.
+  for (auto const &entry: std::vector <std::pair <std::pair <size_t, bool>,
+						   std::string>> {
+	    {{0, true}, "1 2 add"},
+	    {{1, true}, "drop"},
+	    {{2, true}, "swap"},
+	    {{1, true}, "1 drop drop"},
+	    {{3, true}, "rot"},
+	    {{2, true}, "add"},
+	    {{2, true}, "?eq"},
+	    {{1, true}, "(drop, 1 swap)"},
+	    {{1, false}, "(drop, 1 swap) drop"},
+	    {{3, true}, "[drop drop]"},
+	    {{1, true}, "[dup]"},
+	    {{0, true}, "[1 2 add]"},
+	    {{0, true}, "{drop}"},
+	    {{1, true}, "?(elem)"},
+	    {{2, true}, "!(drop elem)"},
+	    {{1, true}, "(dup drop)*"},
+	    {{1, false}, "(drop)*"},
+	    {{0, false}, "(1, 2 3) drop drop"},
+	    {{0, false}, "let A := 1; A drop"},
+	    {{0, false}, "{drop} apply"},
+	    {{1, true}, "\"%s\""},
+	    {{2, true}, "\"%s%s\""},
+	    {{0, true}, "\"%(1%)\""},
+	    {{2, true}, "\"%(drop%)\""},
+	})
+    {
+      auto stats = get_build_stats (*builtins, entry.second);
+      EXPECT_EQ (entry.first.first, stats.stack_need) << entry.second;
+      EXPECT_EQ (entry.first.second, stats.stack_need_known) << entry.second;
+    }
+}
+
+TEST_F (ZwTest, optimize)
+{
+  // Each query should optimize to the same tree as its plain
+  // equivalent.
+  for (auto const &entry: std::vector <std::pair <std::string,
+						   std::string>> {
+	    {"1 2 add", "3"},
+	    {"1 2 add 3 mul 4 sub", "5"},
+	    {"\"a%(1%)b%(2 3 add%)\"", "\"a1b5\""},
+	    {"1 0 div", "1 0 div"},
+	    {"elem 1 drop", "elem"},
+	    {"elem dup drop swap swap", "elem"},
+	    {"[1] ?(elem) ?empty", "[1] ?empty ?(elem)"},
+	    {"\"\" !(1) !empty ?(1) ?empty", "\"\" !empty ?empty !(1) ?(1)"},
+
+	    // Predicates are only moved where they can't fail, or the
+	    // predicates that they skip may have guarded them.
+	    {"?(elem) ?0 elem", "?(elem) ?0 elem"},
+	    {"elem ?(elem) ?empty", "elem ?(elem) ?empty"},
+	    {"[1] ?(elem) ?match", "[1] ?(elem) ?match"},
+	    {"\"a\" [1, \"a\"] elem ?(?T_STR) ?eq",
+	     "\"a\" [1, \"a\"] elem ?(?T_STR) ?eq"},
+	})
+    EXPECT_EQ (dump_tree (nullptr, entry.second),
+	       dump_tree (builtins.get (), entry.first)) << entry.first;
+}
+
+TEST_F (ZwTest, explain)
+{
+  EXPECT_EQ ("const<1>\nconst<2>\n",
+	     explain_query (*builtins, std::make_unique <stack> (), "1 2",
+			    false));
+
+  // The origin is not in the plan, so the first op has no count of
+  // stacks in.
+  std::string plan = explain_query (*builtins, std::make_unique <stack> (),
+				    "1 2", true);
+  EXPECT_NE (std::string::npos,
+	     plan.find ("const<1>  (out=1 next=2 time=")) << plan;
+  EXPECT_NE (std::string::npos,
+	     plan.find ("const<2>  (in=1 out=1 next=2 time=")) << plan;
+
+  // Ops of sub-expressions are nested in the op that runs them.
+  plan = explain_query (*builtins, std::make_unique <stack> (),
+			"[1, 2]", true);
+  EXPECT_NE (std::string::npos, plan.find ("\n    const<1>  (out=1 ")) << plan;
+  EXPECT_NE (std::string::npos, plan.find ("\n    const<2>  (out=1 ")) << plan;
+}
@@ -30,9 +30,11 @@
 #include "test-zw-aux.hh"
 #include "op.hh"
 #include "parser.hh"
+#include "plan.hh"
 #include "scon.hh"
 
 #include "std-memory.hh"
+#include <sstream>
 
 std::unique_ptr <stack>
 stack_with_value (std::unique_ptr <value> v)
@@ -81,3 +83,53 @@ get_parse_error (vocabulary &voc, std::string q)
 
   return "";
 }
+
+build_stats
+get_build_stats (vocabulary &voc, std::string q, bool simplify)
+{
+  layout l;
+  auto origin = std::make_shared <op_origin> (l);
+  build_stats stats;
+  tree t = parse_query (q);
+  if (simplify)
+    t.simplify ();
+  t.build_exec (l, origin, voc, &stats);
+  return stats;
+}
+
+std::string
+dump_tree (vocabulary const *voc, std::string q)
+{
+  tree t = parse_query (q);
+  t.simplify ();
+  if (voc != nullptr)
+    t.optimize (*voc);
+
+  std::ostringstream ss;
+  ss << t;
+  return ss.str ();
+}
+
+std::string
+explain_query (vocabulary &voc, std::unique_ptr <stack> stk,
+	       std::string q, bool analyze)
+{
+  layout l;
+  auto origin = std::make_shared <op_origin> (l);
+  query_plan plan;
+  build_stats stats;
+  stats.plan = &plan;
+  auto op = parse_query (q).build_exec (l, origin, voc, &stats);
+
+  {
+    scon sc {l};
+    scon_guard sg {sc, *op};
+    origin->set_next (sc, std::move (stk));
+    while (op->next (sc) != nullptr)
+      ;
+  }
+
+  std::ostringstream ss;
+  plan.dump (ss, analyze);
+  return ss.str ();
+}
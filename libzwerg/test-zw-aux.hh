@@ -35,6 +35,7 @@
 #include "stack.hh"
 #include "value.hh"
 #include "builtin.hh"
+#include "stack_profile.hh"
 
 std::unique_ptr <stack> stack_with_value (std::unique_ptr <value> v);
 
@@ -43,4 +44,17 @@ run_query (vocabulary &voc, std::unique_ptr <stack> stk, std::string q);
 
 std::string get_parse_error (vocabulary &voc, std::string q);
 
+// Build Q and return statistics of the build.  If SIMPLIFY, the tree
+// is simplified first, like that of a query that dwgrep runs.
+build_stats get_build_stats (vocabulary &voc, std::string q,
+			     bool simplify = false);
+
+// Parse Q and print the resulting tree.  If VOC is not NULL, the tree
+// is optimized with it.
+std::string dump_tree (vocabulary const *voc, std::string q);
+
+// Build Q for explaining, run it on STK, and return the plan.
+std::string explain_query (vocabulary &voc, std::unique_ptr <stack> stk,
+			   std::string q, bool analyze);
+
 #endif /* TEST_ZW_AUX_H */
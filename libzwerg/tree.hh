@@ -135,6 +135,7 @@ TREE_TYPES
 class op;
 class pred;
 class scope;
+struct build_stats;
 
 // This is for communication between lexical and syntactic analyzers
 // and the rest of the world.  It uses naked pointers all over the
@@ -188,9 +189,25 @@ public:
   // would only create a series of nested op's).  UPSTREAM should be
   // an op_origin if this is the toplevel-most expression, otherwise it
   // should be a valid op that the op produced by this node feeds off.
+  //
+  // Overloaded words whose operand types are known at this point are
+  // bound directly to the overload that they would select.  If STATS
+  // is not NULL, it is updated with how many of them there were.
   std::shared_ptr <op>
   build_exec (layout &l, std::shared_ptr <op> upstream,
-	      vocabulary const &voc) const;
+	      vocabulary const &voc, build_stats *stats = nullptr) const;
+
+  // === Optimization interface ===
+  //
+  // The following method is implemented in tree_opt.cc.
+
+  // Rewrite the tree into an equivalent one that is cheaper to run.
+  // Constant arithmetic and format strings are folded, stack
+  // shuffling that cancels out is removed, and in runs of assertions,
+  // cheap ones that can't fail on the values that reach them are
+  // moved ahead of sub-expression ones.  Words are looked up in VOC,
+  // unless the tree binds their name.
+  void optimize (vocabulary const &voc);
 
   // === Parser interface ===
   //
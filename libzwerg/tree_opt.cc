@@ -0,0 +1,366 @@
+/*
+   Copyright (C) 2018 Petr Machata
+   This file is part of dwgrep.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   dwgrep is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <exception>
+
+#include "builtin-shf.hh"
+#include "op.hh"
+#include "overload.hh"
+#include "scon.hh"
+#include "tree.hh"
+#include "value-cst.hh"
+#include "value-seq.hh"
+#include "value-str.hh"
+
+namespace
+{
+  void
+  collect_bound_names (tree const &t, std::set <std::string> &names)
+  {
+    if (t.m_tt == tree_type::BIND)
+      names.insert (t.str ());
+    for (auto const &child: t.m_children)
+      collect_bound_names (child, names);
+  }
+
+  // How much it costs to evaluate a predicate, relative to other
+  // predicates.
+  enum class pred_cost
+    {
+      none,		// Not a predicate.
+      cheap,		// A predicate word, such as ?TAG_* or ?AT_*.
+      expensive,	// Involves a sub-expression.
+    };
+
+  class optimizer
+  {
+    vocabulary const &m_voc;
+
+    // Names that the query binds.  Words of these names may not
+    // refer to builtins, and are left alone.
+    std::set <std::string> m_bound;
+
+    // If T is a word that refers to a builtin, return that builtin.
+    std::shared_ptr <builtin const>
+    find_builtin (tree const &t) const
+    {
+      if (t.m_tt == tree_type::F_BUILTIN)
+	return t.m_builtin;
+      if (t.m_tt != tree_type::READ || m_bound.count (t.str ()) > 0)
+	return nullptr;
+      return m_voc.find (t.str ());
+    }
+
+    template <class Op>
+    bool
+    is_shuffle (tree const &t) const
+    {
+      auto bi = find_builtin (t);
+      return dynamic_cast <shuffle_builtin <Op> const *> (bi.get ())
+	!= nullptr;
+    }
+
+    // Whether T is one of the arithmetic words.  These have no side
+    // effects, so they can be evaluated up front on constant operands.
+    bool
+    is_arith (tree const &t) const
+    {
+      auto bi = find_builtin (t);
+      if (dynamic_cast <overloaded_op_builtin const *> (bi.get ()) == nullptr)
+	return false;
+
+      for (char const *name: {"add", "sub", "mul", "div", "mod"})
+	if (std::strcmp (bi->name (), name) == 0)
+	  return true;
+      return false;
+    }
+
+    static bool
+    is_literal (tree const &t)
+    {
+      return t.m_tt == tree_type::CONST || t.m_tt == tree_type::STR;
+    }
+
+    pred_cost
+    assert_cost (tree const &t) const
+    {
+      switch (t.m_tt)
+	{
+	case tree_type::F_BUILTIN:
+	  return pred_cost::cheap;
+
+	case tree_type::PRED_NOT:
+	  return assert_cost (t.child (0));
+
+	case tree_type::PRED_AND:
+	case tree_type::PRED_OR:
+	  return std::max (assert_cost (t.child (0)),
+			   assert_cost (t.child (1)));
+
+	default:
+	  return pred_cost::expensive;
+	}
+    }
+
+    // If T is a predicate, i.e. something that lets some stacks
+    // through unchanged and drops others, return what it costs.
+    pred_cost
+    cost (tree const &t) const
+    {
+      if (t.m_tt == tree_type::ASSERT)
+	return assert_cost (t.child (0));
+
+      if (auto bi = find_builtin (t))
+	{
+	  layout l;
+	  if (bi->build_pred (l) != nullptr)
+	    return pred_cost::cheap;
+	}
+
+      return pred_cost::none;
+    }
+
+    // Run T, which shall not take anything from stack.  If it yields
+    // a single stack with a single constant or string, replace T with
+    // a literal of that value and return true.  Errors are left to be
+    // reported at runtime.
+    bool
+    fold (tree &t) const
+    {
+      std::unique_ptr <value> v;
+      try
+	{
+	  layout l;
+	  auto origin = std::make_shared <op_origin> (l);
+	  auto op = t.build_exec (l, origin, m_voc);
+
+	  scon sc {l};
+	  scon_guard sg {sc, *op};
+	  origin->set_next (sc, std::make_unique <stack> ());
+
+	  auto stk = op->next (sc);
+	  if (stk == nullptr || stk->size () != 1 || op->next (sc) != nullptr)
+	    return false;
+	  v = stk->pop ();
+	}
+      catch (std::exception const &)
+	{
+	  return false;
+	}
+
+      if (auto cst = value::as <value_cst> (v.get ()))
+	t = tree {tree_type::CONST, cst->get_constant ()};
+      else if (auto str = value::as <value_str> (v.get ()))
+	t = tree {tree_type::STR, str->get_string ()};
+      else
+	return false;
+
+      return true;
+    }
+
+    // Remove words that cancel out and fold arithmetic on literals
+    // in a CAT node T.  Returns true if anything changed.
+    bool
+    reduce_cat (tree &t) const
+    {
+      auto &cs = t.m_children;
+      for (size_t i = 0; i + 1 < cs.size (); ++i)
+	{
+	  // (dup drop), (swap swap) and (LITERAL drop) have no effect.
+	  if (((is_shuffle <op_dup> (cs[i]) || is_literal (cs[i]))
+	       && is_shuffle <op_drop> (cs[i + 1]))
+	      || (is_shuffle <op_swap> (cs[i])
+		  && is_shuffle <op_swap> (cs[i + 1])))
+	    {
+	      cs.erase (cs.begin () + i, cs.begin () + i + 2);
+	      return true;
+	    }
+
+	  // LITERAL LITERAL ARITH.
+	  if (i + 2 < cs.size () && is_literal (cs[i])
+	      && is_literal (cs[i + 1]) && is_arith (cs[i + 2]))
+	    {
+	      tree sub {tree_type::CAT};
+	      sub.m_children.assign (cs.begin () + i, cs.begin () + i + 3);
+	      if (fold (sub))
+		{
+		  cs[i] = std::move (sub);
+		  cs.erase (cs.begin () + i + 1, cs.begin () + i + 3);
+		  return true;
+		}
+	    }
+	}
+      return false;
+    }
+
+    // If every stack that T yields has a value of the same type on
+    // TOS, store that type to VT and return true.
+    bool
+    yields_type (tree const &t, std::vector <value_type> &vt) const
+    {
+      switch (t.m_tt)
+	{
+	case tree_type::CONST:
+	  vt = {value_cst::vtype};
+	  return true;
+
+	case tree_type::STR:
+	case tree_type::FORMAT:
+	  vt = {value_str::vtype};
+	  return true;
+
+	case tree_type::CAPTURE:
+	  vt = {value_seq::vtype};
+	  return true;
+
+	default:
+	  break;
+	}
+
+      auto obi = std::dynamic_pointer_cast <overloaded_op_builtin const>
+	(find_builtin (t));
+      if (obi == nullptr)
+	return false;
+
+      vt.clear ();
+      for (auto const &ovl: obi->get_overload_tab ()->get_overloads ())
+	{
+	  auto pm = std::get <1> (ovl)->protomap ();
+	  if (pm.empty ())
+	    return false;
+	  for (auto const &proto: pm)
+	    {
+	      auto const &out = std::get <2> (proto);
+	      if (out.empty () || (! vt.empty () && vt.front () != out.back ()))
+		return false;
+	      vt = {out.back ()};
+	    }
+	}
+      return ! vt.empty ();
+    }
+
+    // Whether predicate T has an overload for VT on TOS, so that it
+    // can't fail on stacks that have it.
+    bool
+    accepts (tree const &t, value_type vt) const
+    {
+      tree const *u = &t;
+      if (u->m_tt == tree_type::ASSERT)
+	{
+	  u = &u->child (0);
+	  while (u->m_tt == tree_type::PRED_NOT)
+	    u = &u->child (0);
+	  if (u->m_tt != tree_type::F_BUILTIN)
+	    return false;
+	}
+
+      auto obi = std::dynamic_pointer_cast <overloaded_pred_builtin const>
+	(find_builtin (*u));
+      if (obi == nullptr)
+	return false;
+
+      for (auto const &ovl: obi->get_overload_tab ()->get_overloads ())
+	if (std::get <0> (ovl) == selector {vt})
+	  return true;
+      return false;
+    }
+
+    // Predicates don't change the stacks that they let through, so
+    // their order in a run of predicates doesn't matter, as long as
+    // none of them fails or reports errors on stacks that another
+    // would have dropped.  Move cheap ones that can't fail on what
+    // reaches them ahead, so that fewer stacks get to expensive
+    // ones.  That also brings ?TAG_* and ?AT_* next to the word that
+    // precedes the run, where build_exec can push them down into it.
+    void
+    hoist_preds (tree &t) const
+    {
+      auto &cs = t.m_children;
+      for (auto it = cs.begin (); it != cs.end (); )
+	{
+	  auto jt = std::find_if (it, cs.end (), [this] (tree const &c)
+				  { return cost (c) == pred_cost::none; });
+
+	  std::vector <value_type> vt;
+	  if (it != cs.begin () && yields_type (*(it - 1), vt))
+	    std::stable_partition (it, jt, [this, &vt] (tree const &c)
+				   {
+				     return cost (c) == pred_cost::cheap
+				       && accepts (c, vt.front ());
+				   });
+
+	  it = jt == cs.end () ? jt : jt + 1;
+	}
+    }
+
+  public:
+    optimizer (vocabulary const &voc, tree const &t)
+      : m_voc {voc}
+    {
+      collect_bound_names (t, m_bound);
+    }
+
+    void
+    optimize (tree &t) const
+    {
+      for (auto &child: t.m_children)
+	optimize (child);
+
+      switch (t.m_tt)
+	{
+	case tree_type::CAT:
+	  while (reduce_cat (t))
+	    ;
+	  hoist_preds (t);
+	  if (t.m_children.empty ())
+	    t = tree {tree_type::NOP};
+	  break;
+
+	case tree_type::FORMAT:
+	  // A format string whose parts are all literals is a literal.
+	  if (std::all_of (t.m_children.begin (), t.m_children.end (),
+			   is_literal))
+	    fold (t);
+	  break;
+
+	default:
+	  break;
+	}
+    }
+  };
+}
+
+void
+tree::optimize (vocabulary const &voc)
+{
+  optimizer {voc, *this}.optimize (*this);
+  simplify ();
+}
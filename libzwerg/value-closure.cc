@@ -40,7 +40,7 @@ value_type const value_closure::vtype
 value_closure::value_closure (layout op_layout, layout::loc rdv_ll,
 			      std::shared_ptr <op_origin> origin,
 			      std::shared_ptr <op> op,
-			      std::vector <std::unique_ptr <value>> env,
+			      std::vector <shared_value> env,
 			      size_t pos)
   : value {vtype, pos}
   , m_op_layout {op_layout}
@@ -59,12 +59,9 @@ value_closure::show (std::ostream &o) const
 std::unique_ptr <value>
 value_closure::clone () const
 {
-  std::vector <std::unique_ptr <value>> env;
-  for (auto const &envv: m_env)
-    env.push_back (envv->clone ());
+  // The environment is immutable, so the clone can share it.
   return std::make_unique <value_closure> (m_op_layout, m_rdv_ll,
-					   m_origin, m_op,
-					   std::move (env), get_pos ());
+					   m_origin, m_op, m_env, get_pos ());
 }
 
 cmp_result
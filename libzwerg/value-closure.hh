@@ -41,7 +41,7 @@ class value_closure
   layout::loc m_rdv_ll;
   std::shared_ptr <op_origin> m_origin;
   std::shared_ptr <op> m_op;
-  std::vector <std::unique_ptr <value>> m_env;
+  std::vector <shared_value> m_env;
 
 public:
   static value_type const vtype;
@@ -49,7 +49,7 @@ public:
   value_closure (layout op_layout, layout::loc rdv_ll,
 		 std::shared_ptr <op_origin> origin,
 		 std::shared_ptr <op> op,
-		 std::vector <std::unique_ptr <value>> env,
+		 std::vector <shared_value> env,
 		 size_t pos);
 
   void show (std::ostream &o) const override;
@@ -65,8 +65,8 @@ public:
   op &get_op () const
   { return *m_op; }
 
-  value &get_env (unsigned id)
-  { return *m_env[id]; }
+  shared_value const &get_env (unsigned id) const
+  { return m_env[id]; }
 
   layout::loc get_rdv_ll () const
   { return m_rdv_ll; }
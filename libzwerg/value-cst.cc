@@ -27,6 +27,7 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <functional>
 #include <iostream>
 #include <memory>
 
@@ -79,6 +80,15 @@ value_cst::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_cst::hash () const
+{
+  // Constants from different domains may compare equal, so only the
+  // value itself can take part.  Equal values share the bit pattern
+  // regardless of signedness.
+  return std::hash <uint64_t> {} (m_cst.value ().m_u);
+}
+
 
 // value
 
@@ -158,11 +168,10 @@ denoted with ``->?`` relation::
 }
 
 std::unique_ptr <value_cst>
-op_add_cst::operate (std::unique_ptr <value_cst> a,
-		     std::unique_ptr <value_cst> b) const
+add_csts (value_cst const &a, value_cst const &b)
 {
   return simple_arith_op
-    (*a, *b,
+    (a, b,
      [] (constant const &cst_a, constant const &cst_b,
 	 constant_dom const *d)
      {
@@ -171,6 +180,13 @@ op_add_cst::operate (std::unique_ptr <value_cst> a,
      });
 }
 
+std::unique_ptr <value_cst>
+op_add_cst::operate (std::unique_ptr <value_cst> a,
+		     std::unique_ptr <value_cst> b) const
+{
+  return add_csts (*a, *b);
+}
+
 std::string
 op_add_cst::docstring ()
 {
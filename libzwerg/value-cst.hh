@@ -55,6 +55,7 @@ public:
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 struct op_value_cst
@@ -70,6 +71,10 @@ struct op_value_cst
 
 // Arithmetic operator overloads.
 
+// Add A and B the way the word add does.  Returns nullptr if the sum
+// can't be represented.
+std::unique_ptr <value_cst> add_csts (value_cst const &a, value_cst const &b);
+
 struct op_add_cst
   : public op_overload <value_cst, value_cst, value_cst>
 {
@@ -31,9 +31,14 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
 #include <system_error>
+#include <tuple>
 #include <cerrno>
 
 #include "atval.hh"
@@ -113,13 +118,8 @@ namespace
   };
 
   std::shared_ptr <Dwfl>
-  open_dwfl (std::string const &fn)
+  open_dwfl (std::string const &fn, fd_handle &fd)
   {
-    fd_handle fd = open (fn.c_str (), O_RDONLY);
-    if (fd == -1)
-      throw std::runtime_error
-	(std::error_code (errno, std::system_category ()).message ());
-
     const static Dwfl_Callbacks callbacks =
       {
 	.find_elf = dwfl_build_id_find_elf,
@@ -146,13 +146,77 @@ namespace
 
     return dwfl;
   }
+
+  std::atomic <size_t> dwctx_cache_size {8};
+
+  // Opening a Dwarf is expensive, and so is filling the caches of its
+  // context.  Contexts are therefore shared among all values that
+  // refer to the same file, as identified by device, inode, size and
+  // modification time.  Contexts are found through weak pointers while
+  // there are values using them, and the few most recently opened ones
+  // are kept alive for a while after the last such value is gone.
+  // Contexts are not thread-safe, so each thread has a cache of its
+  // own.
+  std::shared_ptr <dwfl_context>
+  open_dwctx (std::string const &fn)
+  {
+    typedef std::tuple <dev_t, ino_t, off_t, time_t, long> key_t;
+    thread_local std::map <key_t, std::weak_ptr <dwfl_context>> contexts;
+    thread_local std::list <std::shared_ptr <dwfl_context>> recent;
+
+    fd_handle fd = open (fn.c_str (), O_RDONLY);
+    if (fd == -1)
+      throw std::runtime_error
+	(std::error_code (errno, std::system_category ()).message ());
+
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+      throw std::runtime_error
+	(std::error_code (errno, std::system_category ()).message ());
+
+    auto remember = [] (std::shared_ptr <dwfl_context> dwctx)
+      {
+	recent.remove (dwctx);
+	recent.push_front (dwctx);
+	for (size_t limit = dwctx_cache_size; recent.size () > limit; )
+	  recent.pop_back ();
+      };
+
+    key_t key {st.st_dev, st.st_ino, st.st_size,
+	       st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+    auto it = contexts.find (key);
+    if (it != contexts.end ())
+      if (auto ret = it->second.lock ())
+	{
+	  remember (ret);
+	  return ret;
+	}
+
+    auto ret = std::make_shared <dwfl_context> (open_dwfl (fn, fd));
+    contexts[key] = ret;
+    remember (ret);
+
+    for (auto jt = contexts.begin (); jt != contexts.end (); )
+      if (jt->second.expired ())
+	jt = contexts.erase (jt);
+      else
+	++jt;
+
+    return ret;
+  }
+}
+
+void
+value_dwarf::set_cache_size (size_t size)
+{
+  dwctx_cache_size = size;
 }
 
 value_dwarf::value_dwarf (std::string const &fn, size_t pos, doneness d)
   : value {vtype, pos}
   , doneness_aspect {d}
   , m_fn {fn}
-  , m_dwctx {std::make_shared <dwfl_context> (open_dwfl (fn))}
+  , m_dwctx {open_dwctx (fn)}
 {}
 
 value_dwarf::value_dwarf (std::string const &fn,
@@ -185,6 +249,12 @@ value_dwarf::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_dwarf::hash () const
+{
+  return std::hash <Dwfl *> {} (m_dwctx->get_dwfl ());
+}
+
 
 value_type const value_cu::vtype = value_type::alloc ("T_CU",
 R"docstring(
@@ -221,6 +291,12 @@ value_cu::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_cu::hash () const
+{
+  return std::hash <Dwarf_CU *> {} (&m_cu);
+}
+
 
 namespace
 {
@@ -298,6 +374,15 @@ value_die::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_die::hash () const
+{
+  // Import paths are left out, DIEs that only differ in them may
+  // still compare equal.
+  return hash_combine (std::hash <Dwarf *> {} (dwarf_cu_getdwarf (m_die.cu)),
+		       dwarf_dieoffset ((Dwarf_Die *) &m_die));
+}
+
 namespace
 {
   bool
@@ -400,6 +485,13 @@ value_attr::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_attr::hash () const
+{
+  Dwarf_Off off = dwarf_dieoffset (const_cast <Dwarf_Die *> (&get_die ()));
+  return hash_combine (off, dwarf_whatattr ((Dwarf_Attribute *) &m_attr));
+}
+
 
 value_type const value_abbrev_unit::vtype = value_type::alloc ("T_ABBREV_UNIT",
 R"docstring(
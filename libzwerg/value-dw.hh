@@ -33,6 +33,7 @@
 #include "std-memory.hh"
 #include "value.hh"
 #include "dwfl_context.hh"
+#include "cu_pool.hh"
 
 enum class doneness
   {
@@ -67,6 +68,9 @@ class value_dwarf
   std::string m_fn;
   std::shared_ptr <dwfl_context> m_dwctx;
 
+  // When set, unit and entry only visit units taken from this pool.
+  std::shared_ptr <cu_pool> m_cu_pool;
+
 public:
   static value_type const vtype;
 
@@ -76,6 +80,11 @@ public:
 
   value_dwarf (value_dwarf const &that) = default;
 
+  // Set how many Dwarf contexts that are no longer referenced by any
+  // value are kept around on each thread for when the same file is
+  // opened again.
+  static void set_cache_size (size_t size);
+
   std::string &get_fn ()
   { return m_fn; }
 
@@ -85,8 +94,15 @@ public:
   std::shared_ptr <dwfl_context> get_dwctx () const
   { return m_dwctx; }
 
+  std::shared_ptr <cu_pool> get_cu_pool () const
+  { return m_cu_pool; }
+
+  void set_cu_pool (std::shared_ptr <cu_pool> pool)
+  { m_cu_pool = pool; }
+
   void show (std::ostream &o) const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
   std::unique_ptr <value> clone () const override;
 };
 
@@ -127,6 +143,7 @@ public:
 
   void show (std::ostream &o) const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
   std::unique_ptr <value> clone () const override;
 };
 
@@ -214,6 +231,7 @@ public:
   { return std::make_unique <value_die> (*this); }
 
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 
   std::unique_ptr <value_die> get_parent () const;
 
@@ -273,6 +291,7 @@ public:
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 
   value_dwarf &
   get_dwarf ()
@@ -142,6 +142,15 @@ value_seq::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_seq::hash () const
+{
+  size_t ret = m_seq->size ();
+  for (auto const &v: *m_seq)
+    ret = hash_combine (ret, v->hash ());
+  return ret;
+}
+
 value_seq
 op_add_seq::operate (std::unique_ptr <value_seq> a,
 		     std::unique_ptr <value_seq> b) const
@@ -171,35 +180,6 @@ using ``add``::
 )docstring";
 }
 
-value_cst
-op_length_seq::operate (std::unique_ptr <value_seq> a) const
-{
-  return {constant {a->get_seq ()->size (), &dec_constant_dom}, 0};
-}
-
-std::string
-op_length_seq::docstring ()
-{
-  return
-R"docstring(
-
-Yield number of elements of sequence on TOS.
-
-E.g. the following tests whether the DIE's whose all attributes report
-the same form as their abbreviations suggest, comprise all DIE's.
-This test comes from dwgrep's test suite::
-
-	[entry ([abbrev attribute label] == [attribute label])] length
-	== [entry] length
-
-(Note that this isn't anything that should be universally true, though
-it typically will, and it is for the particular file that this test is
-run on.  Attributes for which their abbreviation suggests
-``DW_FORM_indirect`` will themselves have a different form.)
-
-)docstring";
-}
-
 
 namespace
 {
@@ -68,6 +68,7 @@ public:
   void show (std::ostream &o) const override;
   std::unique_ptr <value> clone () const override;
   cmp_result cmp (value const &that) const override;
+  size_t hash () const override;
 };
 
 struct op_add_seq
@@ -81,16 +82,6 @@ struct op_add_seq
   static std::string docstring ();
 };
 
-struct op_length_seq
-  : public op_once_overload <value_cst, value_seq>
-{
-  using op_once_overload::op_once_overload;
-
-  value_cst operate (std::unique_ptr <value_seq> a) const override;
-
-  static std::string docstring ();
-};
-
 struct op_elem_seq
   : public op_yielding_overload <value, value_seq>
 {
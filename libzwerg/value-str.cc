@@ -27,9 +27,14 @@
    the GNU Lesser General Public License along with this program.  If
    not, see <http://www.gnu.org/licenses/>.  */
 
+#include <cassert>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <regex.h>
+#include <unordered_map>
 
 #include "value-str.hh"
 #include "overload.hh"
@@ -69,6 +74,12 @@ value_str::cmp (value const &that) const
     return cmp_result::fail;
 }
 
+size_t
+value_str::hash () const
+{
+  return std::hash <std::string> {} (m_str);
+}
+
 
 value_str
 op_add_str::operate (std::unique_ptr <value_str> a,
@@ -306,37 +317,181 @@ pred_ends_str::docstring ()
 
 // ?match
 
-pred_result
-pred_match_str::result (value_str &haystack, value_str &needle) const
+namespace
 {
-  regex_t re;
-  if (regcomp (&re, needle.get_string ().c_str(),
-	       REG_EXTENDED | REG_NOSUB) != 0)
+  // A regular expression as used by ?match.  Patterns that, searched
+  // for anywhere in the haystack, amount to looking for a fixed
+  // string (possibly anchored at either end) bypass the regex engine
+  // altogether.
+  class match_pattern
+  {
+    bool m_literal;
+    bool m_left;
+    bool m_right;
+    std::string m_str;
+    regex_t m_re;
+    int m_err;
+
+    static bool
+    is_escaped (char const *pat, size_t i)
     {
-      std::cerr << "Error: could not compile regular expression: '"
-		<< needle.get_string () << "'\n";
-      return pred_result::fail;
+      size_t n = 0;
+      while (i > n && pat[i - n - 1] == '\\')
+	++n;
+      return n % 2 == 1;
     }
 
-  const int reti = regexec (&re, haystack.get_string ().c_str (),
-			    /* nmatch: size of pmatch array */ 0,
-			    /* pmatch: array of matches */ NULL,
-			    /* no extra flags */ 0);
+    bool
+    parse_literal (char const *pat)
+    {
+      static char const *const meta = "^.[]$()|*+?{}";
+      size_t i = 0;
+      size_t n = std::strlen (pat);
 
-  pred_result retval = pred_result::fail;
-  if (reti == 0)
-    retval = pred_result::yes;
-  else if (reti == REG_NOMATCH)
-    retval = pred_result::no;
-  else
+      if (i < n && pat[i] == '^')
+	{
+	  m_left = true;
+	  ++i;
+	}
+      if (n - i >= 2 && pat[i] == '.' && pat[i + 1] == '*')
+	{
+	  m_left = false;
+	  i += 2;
+	}
+
+      if (n > i && pat[n - 1] == '$' && ! is_escaped (pat, n - 1))
+	{
+	  m_right = true;
+	  --n;
+	}
+      if (n - i >= 2 && pat[n - 2] == '.' && pat[n - 1] == '*'
+	  && ! is_escaped (pat, n - 2))
+	{
+	  m_right = false;
+	  n -= 2;
+	}
+
+      for (; i < n; ++i)
+	if (pat[i] == '\\')
+	  {
+	    if (i + 1 == n || pat[i + 1] == '\0'
+		|| (pat[i + 1] != '\\' && std::strchr (meta, pat[i + 1]) == nullptr))
+	      return false;
+	    m_str += pat[++i];
+	  }
+	else if (std::strchr (meta, pat[i]) != nullptr)
+	  return false;
+	else
+	  m_str += pat[i];
+
+      return true;
+    }
+
+  public:
+    explicit match_pattern (std::string const &pattern)
+      : m_left {false}
+      , m_right {false}
+      , m_err {0}
+    {
+      m_literal = parse_literal (pattern.c_str ());
+      if (! m_literal)
+	m_err = regcomp (&m_re, pattern.c_str (), REG_EXTENDED | REG_NOSUB);
+    }
+
+    match_pattern (match_pattern const &that) = delete;
+
+    ~match_pattern ()
     {
+      if (! m_literal && m_err == 0)
+	regfree (&m_re);
+    }
+
+    bool
+    valid () const
+    {
+      return m_err == 0;
+    }
+
+    pred_result
+    match (char const *haystack) const
+    {
+      assert (valid ());
+      if (m_literal)
+	{
+	  if (m_left && m_right)
+	    return pred_result (m_str == haystack);
+	  if (m_left)
+	    return pred_result (std::strncmp (haystack, m_str.c_str (),
+					      m_str.size ()) == 0);
+	  if (m_right)
+	    {
+	      size_t len = std::strlen (haystack);
+	      return pred_result (len >= m_str.size ()
+				  && m_str == haystack + len - m_str.size ());
+	    }
+	  return pred_result (std::strstr (haystack, m_str.c_str ()) != nullptr);
+	}
+
+      const int reti = regexec (&m_re, haystack,
+				/* nmatch: size of pmatch array */ 0,
+				/* pmatch: array of matches */ NULL,
+				/* no extra flags */ 0);
+      if (reti == 0)
+	return pred_result::yes;
+      if (reti == REG_NOMATCH)
+	return pred_result::no;
+
       char msgbuf[100];
-      regerror (reti, &re, msgbuf, sizeof (msgbuf));
+      regerror (reti, &m_re, msgbuf, sizeof (msgbuf));
       std::cerr << "Error: match failed: " << msgbuf << "\n";
+      return pred_result::fail;
+    }
+  };
+
+  // Compiled patterns are kept in a small per-thread LRU cache, so
+  // that a query that matches against the same few patterns over and
+  // over doesn't recompile them, and queries running in parallel
+  // don't need to synchronize.  The returned reference is valid until
+  // the next call on the same thread.
+  match_pattern const &
+  get_match_pattern (std::string const &pattern)
+  {
+    typedef std::list <std::pair <std::string,
+				  std::unique_ptr <match_pattern>>> lru_t;
+    static size_t const max_size = 32;
+    thread_local lru_t lru;
+    thread_local std::unordered_map <std::string, lru_t::iterator> index;
+
+    auto it = index.find (pattern);
+    if (it != index.end ())
+      {
+	lru.splice (lru.begin (), lru, it->second);
+	return *lru.front ().second;
+      }
+
+    lru.emplace_front (pattern, std::make_unique <match_pattern> (pattern));
+    index.emplace (pattern, lru.begin ());
+    if (lru.size () > max_size)
+      {
+	index.erase (lru.back ().first);
+	lru.pop_back ();
+      }
+    return *lru.front ().second;
+  }
+}
+
+pred_result
+pred_match_str::result (value_str &haystack, value_str &needle) const
+{
+  match_pattern const &pat = get_match_pattern (needle.get_string ());
+  if (! pat.valid ())
+    {
+      std::cerr << "Error: could not compile regular expression: '"
+		<< needle.get_string () << "'\n";
+      return pred_result::fail;
     }
 
-  regfree (&re);
-  return retval;
+  return pat.match (haystack.get_string ().c_str ());
 }
 
 std::string
@@ -153,6 +153,12 @@ value::get_type_const () const
   return {get_type ().code (), &slot_type_dom};
 }
 
+size_t
+value::hash () const
+{
+  return get_type ().code ();
+}
+
 std::ostream &
 operator<< (std::ostream &o, value const &v)
 {
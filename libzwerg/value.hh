@@ -33,6 +33,7 @@
 #include <vector>
 
 #include "constant.hh"
+#include "pool.hh"
 
 enum class cmp_result
   {
@@ -53,6 +54,12 @@ compare (T const &a, T const &b)
   return cmp_result::equal;
 }
 
+inline size_t
+hash_combine (size_t seed, size_t h)
+{
+  return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 // We use this to keep track of types of instances of subclasses of
 // class value.  value::as uses this to avoid having to dynamic_cast,
 // which is needlessly flexible and slow for our purposes.
@@ -115,17 +122,31 @@ std::ostream &operator<< (std::ostream &o, value_type const &v);
 extern constant_dom const &slot_type_dom;
 
 class zw_value
+  : public pool_allocated
 {
   value_type const m_type;
   size_t m_pos;
 
+  // Number of stacks that hold this value in addition to the one that
+  // owns it.  Copying a stack shares its values instead of cloning
+  // them, see class stack for details.  shared_value references
+  // count the same way.
+  friend class stack;
+  friend class shared_value;
+  unsigned m_shares;
+
 protected:
   zw_value (value_type t, size_t pos)
     : m_type {t}
     , m_pos {pos}
+    , m_shares {0}
   {}
 
-  zw_value (zw_value const &that) = default;
+  zw_value (zw_value const &that)
+    : m_type {that.m_type}
+    , m_pos {that.m_pos}
+    , m_shares {0}
+  {}
 
 public:
   static value_type const vtype;
@@ -138,6 +159,11 @@ public:
   virtual std::unique_ptr <zw_value> clone () const = 0;
   virtual cmp_result cmp (zw_value const &that) const = 0;
 
+  // Values that compare equal need to have the same hash.  The
+  // default implementation only hashes the value type, subclasses
+  // override it to tell more values apart.
+  virtual size_t hash () const;
+
   void
   set_pos (size_t pos)
   {
@@ -68,6 +68,37 @@ expect_out ()
     rm -f $TMP
 }
 
+# Like expect_out, but OUT only needs to be part of the output.  With
+# --hex, the output is compared as a string of hexadecimal digits.
+expect_out_has ()
+{
+    export total=$((total + 1))
+    FILTER=cat
+    if [ "$1" = "--hex" ]; then
+	FILTER="od -An -tx1 -v"
+	shift
+    fi
+    OUT=$1
+    shift
+    TMP=$(mktemp)
+    GOT=$(timeout $ZW_TEST_TIMEOUT $DWGREP "$@" 2>$TMP | $FILTER)
+    if [ "$FILTER" != cat ]; then
+	GOT=$(echo $GOT | tr -d ' ')
+    fi
+    if [ -s $TMP ]; then
+	fail "$DWGREP" "$@"
+	echo "expected no error" >&2
+	echo -n "    got: " >&2
+	cat $TMP >&2
+    fi
+    if [ "${GOT/${OUT}/}" == "$GOT" ]; then
+	fail "$DWGREP" "$@"
+	echo "expected output with: $OUT" >&2
+	echo "                 got: $GOT" >&2
+    fi
+    rm -f $TMP
+}
+
 expect_count 1 -e '1   10 ?lt'
 expect_count 1 -e '10  10 !lt'
 expect_count 1 -e '100 10 !lt'
@@ -238,6 +269,15 @@ expect_count 7 ./duplicate-const -e '
 	entry (@AT_decl_file =~ ".*petr.*")'
 expect_count 7 ./duplicate-const -e '
 	entry (@AT_decl_file !~ ".*pavel.*")'
+expect_count 1 -e '"foo.bar" "o.b" ?match'
+expect_count 0 -e '"fooxbar" "o\\.b" ?match'
+expect_count 1 -e '"foo.bar" "^foo\\.bar$" ?match'
+expect_count 0 -e '"foo.bar" "^oo" ?match'
+expect_count 1 -e '"foo.bar" "bar$" ?match'
+expect_count 0 -e '"foo.bar" "foo$" ?match'
+expect_count 1 -e '"foo.bar" "^.*bar" ?match'
+expect_count 1 -e '"" "^$" ?match'
+expect_count 2 -e '("ab", "xy", "ba") "^b|y$" ?match'
 
 # Test true/false
 expect_count 1 ./typedef.o -e '
@@ -249,6 +289,22 @@ expect_count 1 ./typedef.o -e '
 expect_count 1 ./nontrivial-types.o -e '
 	entry ?TAG_structure_type dup parent ?(swap offset == 0x2d)'
 
+# Test that entry and child skip DIE's that ?TAG_* and ?AT_* right
+# after them would reject, without otherwise changing the results.
+expect_count 1 ./twocus -e '
+	[entry ?TAG_subprogram pos] == [entry ?(?TAG_subprogram) pos]'
+expect_count 1 ./nullptr.o -e '
+	[entry !TAG_subprogram !AT_name offset] ==
+	[entry ?(!TAG_subprogram) ?(!AT_name) offset]'
+expect_count 1 ./twocus -e '
+	[entry child ?TAG_formal_parameter pos] ==
+	[entry child ?(?TAG_formal_parameter) pos]'
+expect_count 1 ./dwz-partial -e '
+	[entry ?TAG_pointer_type offset] == [entry ?(?TAG_pointer_type) offset]'
+expect_count 1 ./nullptr.o -e 'entry ?AT_name (offset == 0x6e)'
+expect_count 0 ./nullptr.o -e 'raw entry ?AT_name (offset == 0x6e)'
+expect_count 0 ./nullptr.o -e 'entry !AT_name (offset == 0x6e)'
+
 # Check that when promoting assertions close to producers of their
 # slots, we don't move across alternation or closure.
 expect_count 3 ./nontrivial-types.o -e '
@@ -669,6 +725,46 @@ expect_count 1 ./aranges.o -e '
 	     0x1000e, 0x1000f, 0x10010, 0x10011, 0x10012, 0x10013, 0x10014]
 	    relem]'
 
+# scope
+expect_count 1 ./testfile_const_type -e '
+	[0x80482f1 scope offset] == [0x7d, 0xb]'
+
+expect_count 1 ./testfile_const_type -e '
+	[0x80483f0 scope offset] == [0x33, 0xb]'
+
+expect_count 0 ./testfile_const_type -e '
+	(0x80482f3, 0x80483ef, 0x804841b, -1) scope'
+
+expect_count 1 ./bitcount.o -e '
+	|D| D entry ?TAG_lexical_block low |A|
+	[D A scope offset] == [0x9e, 0x70, 0xb]'
+
+expect_count 1 ./bitcount.o -e '
+	|D| D entry ?TAG_subprogram high |A|
+	([D A 1 sub scope offset] == [0x70, 0xb])
+	([D A scope] == [])'
+
+# lookup, entry ?(@AT_name == "...")
+expect_count 2 ./twocus -e '"foo" lookup'
+expect_count 1 ./twocus -e '"main" lookup (offset == 0x80) (pos == 0)'
+expect_count 0 ./twocus -e '"nonexistent" lookup'
+expect_count 1 ./twocus -e '
+	[entry ?(@AT_name == "foo") pos] == [entry ?(@AT_name "foo" ?eq) pos]'
+expect_count 1 ./twocus -e '
+	[entry ("foo" == @AT_name) ?TAG_subprogram offset] == [0x2d, 0xa3]'
+expect_count 1 ./nullptr.o -e '
+	[entry ?(@AT_name == "foo") (pos, offset)]
+	== [entry ?(@AT_name "foo" ?eq) (pos, offset)]'
+expect_count 1 ./nullptr.o -e '
+	[raw entry ?(@AT_name == "foo") (pos, offset)]
+	== [raw entry ?(@AT_name "foo" ?eq) (pos, offset)]'
+expect_count 4 ./dwz-partial -e 'entry ?(@AT_name == "long long unsigned int")'
+expect_count 1 ./dwz-partial -e 'raw entry ?(@AT_name == "long long unsigned int")'
+expect_count 4 ./dwz-partial -e '"long long unsigned int" lookup'
+expect_count 1 ./dwz-partial -e '
+	[entry ?(@AT_name == "long long unsigned int") pos]
+	== [entry ?(@AT_name "long long unsigned int" ?eq) pos]'
+
 expect_count 1 ./pointer_const_value.o -e '
 	entry @AT_const_value == 0'
 
@@ -734,6 +830,9 @@ expect_count 1 ./twocus -e '?(abbrev entry (|A| A pos 1 add == A code))'
 # Test that dwgrep doesn't crash on a DIE whose abbrev claims to have
 # children, but that ends up having none.
 expect_count 3 ./haschildren_childless -e 'entry'
+expect_count 1 ./haschildren_childless -e 'raw entry ?(raw child)'
+expect_count 2 ./haschildren_childless -e 'raw entry !(raw child)'
+expect_count 1 ./haschildren_childless -e 'entry ?(child)'
 
 # Test that dwgrep handles well "dwz -m" files with common debuginfo.
 expect_count 1 ./dwz-dupfile -e 'raw entry (@AT_name == "W")'
@@ -772,6 +871,10 @@ expect_count 1 ./dwz-partial -e '
 	[unit root child (offset == 0x14) parent offset] ==
 	[0x34, 0xa4, 0xe1, 0x11e]'
 
+# Test that every child finds its way back to its parent.
+expect_count 0 ./nontrivial-types.o -e 'entry (|D| D child parent (D !=))'
+expect_count 0 ./dwz-partial -e 'raw entry (|D| D child parent (D !=))'
+
 expect_count 4 ./dwz-partial -e '
 	(|A| A entry (offset == 0x14)
 	     A entry (offset == 0x14)) ?eq'
@@ -913,6 +1016,13 @@ expect_out "\
 9:	0000000000000000     24 ARM_TFUNC	GLOBAL	DEFAULT	main" \
 	 -e '("y-mips.o", "y.o") dwopen symbol (pos == 9)'
 
+# Test that opening the same file again shares the Dwarf context, and
+# with it the caches.
+expect_count 1 -e '"y.o" dwopen "y.o" dwopen ?eq'
+expect_count 1 -e '"y.o" dwopen "y-mips.o" dwopen ?ne'
+expect_count 1 ./nontrivial-types.o -e '
+	[entry parent offset] == ["nontrivial-types.o" dwopen entry parent offset]'
+
 expect_out 'STT_FILE stdin@0
 STT_NOTYPE $a@0
 STT_ARM_TFUNC main@0' \
@@ -1020,6 +1130,11 @@ expect_error "argument*foo*unbound name" --a foo -e ''
 expect_error "argument*drop*stack overflow" --a drop -e ''
 expect_error 'argument*1\?*empty stack' --a '1?' -e ''
 
+# Test that a query refuses input stacks shorter than it needs.  The
+# capture pops the value that its body leaves, so this needs three.
+expect_error 'query needs 3 values' --a 1 --a 2 -e '[drop drop]'
+expect_count 1 --a 1 --a 2 --a 3 -e '[drop drop]'
+
 # Test position.
 expect_out "$(yes 1 | head -n 27)" \
 	   --a '[0,1,2] elem' --a '[0,1,2] elem' --a '[0,1,2] elem' \
@@ -1044,6 +1159,96 @@ expect_out '0
 	   y.o a1.out \
 	   -che 'pos > 1'
 
+# Test that parallel runs keep output in order of files on command line.
+expect_out '1
+0' \
+	   y.o a1.out -j 2 \
+	   -che '(pos == 0) (name == "y.o")'
+
+expect_out '0
+1' \
+	   y.o a1.out -j 2 \
+	   -che '(pos == 1) (name == "a1.out")'
+
+expect_out '1
+0
+0
+1' \
+	   y.o a1.out -j 2 --a '[0,1] elem' \
+	   -che '(|A| pos == A)'
+
+expect_count 2 y.o a1.out -j 0 --unordered -he 'name'
+
+# Test that a file without matches doesn't swallow output of the
+# files after it.
+expect_out 'a1.out' y.o a1.out -j 2 -he '(pos == 1) name'
+
+expect_error 'invalid number of jobs' y.o -j x -e 'name'
+expect_error 'invalid number of open files' y.o --max-open=0 -e 'name'
+
+# Test that files are opened as the query gets to them.  A file that
+# can't be opened doesn't stop the others, and positions of files
+# count arguments.
+expect_error './nonexistent:' y.o ./nonexistent a1.out -e 'name'
+expect_out '0
+1' \
+	   y.o ./nonexistent a1.out -s \
+	   -che '(pos == 2) (name == "a1.out")'
+
+expect_out '1
+0
+0
+1' \
+	   y.o a1.out -j 2 --max-open=1 --a '[0,1] elem' \
+	   -che '(|A| pos == A)'
+
+# Test that splitting a single file by units yields all results.
+expect_count 4 ./dwz-partial -j 3 -e 'unit'
+expect_count 3 ./haschildren_childless -j 2 -e 'entry'
+expect_count 4 ./dwz-partial -j 2 -e 'unit (version == 3)'
+
+# Test machine-readable output formats.
+expect_out '{"values":[[{"type":"T_CONST","value":2,"text":"2"}],"a\tb",{"type":"T_CONST","value":1,"text":"1"}]}' \
+	   --format=jsonl -e '1 "a\tb" [2]'
+expect_out '{"count":2}' --format=jsonl -ce '1, 2'
+expect_error 'unknown output format' --format=xml -e '1'
+
+# Bytes that are not valid UTF-8 are escaped, valid sequences are
+# written as they are.
+expect_out '{"values":["a\u00ffb\u00c3"]}' --format=jsonl -e '"a\xffb\xc3"'
+expect_out '{"values":["é\u00ed\u00a0\u0080"]}' \
+	   --format=jsonl -e '"\xc3\xa9\xed\xa0\x80"'
+
+# Signed constants keep their sign, on their own as well as in
+# attributes of DIE's.
+expect_out '{"values":[{"type":"T_CONST","value":-1,"text":"-1"}]}' \
+	   --format=jsonl -e '-1'
+expect_out_has '"value":-1,' ./enum.o --format=jsonl -e '
+	entry (@AT_name == "f") child (@AT_name == "V")'
+expect_out_has '"value":-1,' ./enum.o --format=jsonl -e '
+	entry (@AT_name == "f") child (@AT_name == "V")
+	attribute ?AT_const_value'
+expect_out_has --hex \
+    '190000007200000000010000006901ffffffffffffffff020000002d31' \
+    --format=binary -e '-1'
+expect_out_has --hex '6901ffffffffffffffff' ./enum.o --format=binary -e '
+	entry (@AT_name == "f") child (@AT_name == "V")'
+expect_out_has --hex '6900ffffffff00000000' ./enum.o --format=binary -e '
+	entry (@AT_name == "e") child (@AT_name == "V") @AT_const_value'
+
+# Test that DIE indices give the same answers when they are first
+# built and when they are loaded from the index directory.
+TMPD=$(mktemp -d)
+for i in 1 2; do
+    expect_count 1 ./dwz-partial --index-dir=$TMPD -e '
+	[entry (offset == 0x14) parent offset] ==
+	[0x34, 0xa4, 0xe1, 0x11e]'
+    expect_count 5 ./dwz-partial --index-dir=$TMPD -e 'raw entry ?root'
+    expect_count 1 ./dwz-partial --index-dir=$TMPD -e '
+	[raw entry ?root offset] == [raw unit root offset]'
+done
+rm -rf $TMPD
+
 # =============================================================================
 
 echo "$total tests total, $failures failures."